@@ -0,0 +1,2522 @@
+#define _GNU_SOURCE
+#include <time.h>
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <sys/inotify.h>
+#include <sys/timerfd.h>
+#include <sys/resource.h>
+#include <poll.h>
+#include <dirent.h>
+#include <stdint.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <errno.h>
+#include "flush.h"
+
+#define MAXLEN 200
+#define ZYGOTE_BUFLEN 65536
+#define ZYGOTE_SPAWNED 1
+#define ZYGOTE_EXITED 2
+#define CACHE_HEADER "flush-cache %03d\n"
+#define CACHE_HEADERLEN 16
+#define CACHE_BUFLEN 65536
+#define CACHE_MAXSIZE (64 * 1024 * 1024)
+#define NODE_SIMPLE 1
+#define NODE_GROUP 2
+#define OP_SEQ 1
+#define OP_AND 2
+#define OP_OR 3
+#define OP_BG 4
+#define SUBST_MAX 16
+#define JOBS_MAXTREE 256
+#define JOBS_BUFLEN 4096
+#define ONCHANGE_DEBOUNCE 100
+#define ONCHANGE_EVENTS (IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_CREATE | IN_DELETE | IN_MOVED_FROM \
+        | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF)
+
+extern char **environ;
+
+/* Struct for a process of a job, with its /proc files kept open for "jobs -l" */
+struct procFiles {
+    int pid;
+    int statFd;
+    int ioFd;
+    int childrenFd;
+};
+
+/* Struvt for the linked list process. A deadline of 0 means the process has no timeout, and a quiet
+ * process is reaped without reporting its status */
+struct linkedProcess {
+    int pid;
+    char name[MAXLEN];
+    int quiet;
+    long long deadline;
+    long long killAfter;
+    int timedOut;
+    long long started;
+    long long lastSample;
+    unsigned long long lastTicks;
+    struct procFiles *tree;
+    int treeCount;
+    struct linkedProcess *previous;
+    struct linkedProcess *next;
+};
+
+/* Struct for the process substitutions of a command. fds holds the ends of the pipes that the command
+ * inherits, followed by -1 */
+struct substitutions {
+    int count;
+    int pids[SUBST_MAX];
+    int fds[SUBST_MAX + 1];
+    char *names[SUBST_MAX];
+    char paths[SUBST_MAX][32];
+};
+
+/* Struct for a message sent from the zygote back to the shell */
+struct zygoteReply {
+    int type;
+    int pid;
+    int status;
+};
+
+/* Struct for an exit status reported by the zygote that has not been collected yet */
+struct reapedProcess {
+    int pid;
+    int status;
+    struct reapedProcess *next;
+};
+
+/* Struct for an entry in the result cache, used when evicting old entries */
+struct cacheEntry {
+    char name[MAXLEN];
+    off_t size;
+    struct timespec used;
+};
+
+/* Struct for a command in a parsed command list. Each node is joined to the next one by op */
+struct commandNode {
+    int type;
+    int op;
+    char name[MAXLEN];
+    char **args;
+    char **inputs;
+    char **outputs;
+    struct commandNode *body;
+    struct commandNode *next;
+};
+
+/* Struct for the state of one shell. head and tail is the linked list of background tasks, and the
+ * zygote socket is -1 when flush forks directly. A session has its own directory in cwd and its own
+ * environment in env, otherwise cwd is -1 and env is NULL and the ones of the process are used.
+ * Commands get jobFds as their stdio, while the messages of the shell itself go to fds. fileLimit is
+ * the file limit of the process when the context was created, which commands get back */
+struct flush_ctx {
+    int flags;
+    struct rlimit fileLimit;
+    int fds[3];
+    int jobFds[3];
+    int cwd;
+    char **env;
+    struct linkedProcess *head;
+    struct linkedProcess *tail;
+    int zygoteSocket;
+    char *zygoteBuffer;
+    int timerFd;
+    struct reapedProcess *reaped;
+    int dagParallel;
+    flush_callback callback;
+    void *callbackData;
+};
+
+static struct commandNode *parseList(flush_ctx *ctx, char **args, int *index, int depth);
+static int runList(flush_ctx *ctx, struct commandNode *node);
+static int execute(flush_ctx *ctx, char **args, char *input);
+static int isBuiltin(char *name);
+static void drainZygote(flush_ctx *ctx);
+static int isReaped(flush_ctx *ctx, int pid);
+
+/* Method to print an error like perror, but to the stderr of the context */
+static void printError(flush_ctx *ctx, const char *message) {
+    dprintf(ctx->fds[2], "%s: %s\n", message, strerror(errno));
+}
+
+/* Method to get the directory that paths are relative to */
+static int getDirFd(flush_ctx *ctx) {
+    return ctx->cwd != -1 ? ctx->cwd : AT_FDCWD;
+}
+
+/* Method to get the environment given to commands */
+static char **getEnviron(flush_ctx *ctx) {
+    return ctx->env != NULL ? ctx->env : environ;
+}
+
+/* Method to look up a variable in the environment of the context */
+static char *getVariable(flush_ctx *ctx, const char *name) {
+    size_t length = strlen(name);
+    for (char **str = getEnviron(ctx); *str != NULL; str++) {
+        if (strncmp(*str, name, length) == 0 && (*str)[length] == '=') {
+            return *str + length + 1;
+        }
+    }
+    return NULL;
+}
+
+/* Method to set a variable in the environment of the context, or remove it if value is NULL */
+static int setVariable(flush_ctx *ctx, const char *name, const char *value) {
+    if (ctx->env == NULL) {
+        return value != NULL ? setenv(name, value, 1) : unsetenv(name);
+    }
+
+    size_t length = strlen(name);
+    int count = 0;
+    while (ctx->env[count] != NULL) {
+        count++;
+    }
+
+    /* Removes the old value */
+    for (int i = 0; i < count; i++) {
+        if (strncmp(ctx->env[i], name, length) == 0 && ctx->env[i][length] == '=') {
+            free(ctx->env[i]);
+            ctx->env[i] = ctx->env[--count];
+            ctx->env[count] = NULL;
+            break;
+        }
+    }
+    if (value == NULL) {
+        return 0;
+    }
+
+    char **env = realloc(ctx->env, (count + 2) * sizeof(char *));
+    char *str = malloc(length + strlen(value) + 2);
+    if (env == NULL || str == NULL) {
+        free(str);
+        return -1;
+    }
+    sprintf(str, "%s=%s", name, value);
+    env[count] = str;
+    env[count + 1] = NULL;
+    ctx->env = env;
+    return 0;
+}
+
+/* Method to change the directory of the shell. A session only changes its own directory */
+static int changeDirectory(flush_ctx *ctx, const char *path) {
+    if (ctx->cwd == -1) {
+        return chdir(path);
+    }
+
+    int fd = openat(ctx->cwd, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1) {
+        return -1;
+    }
+    close(ctx->cwd);
+    ctx->cwd = fd;
+    return 0;
+}
+
+/* Method to give a child the default signal handling, since the shell may block or ignore signals */
+static void resetSignals() {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigprocmask(SIG_SETMASK, &mask, NULL);
+    signal(SIGPIPE, SIG_DFL);
+}
+
+/* Method to get the milliseconds of the monotonic clock */
+static long long getMilliseconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000LL + now.tv_nsec / 1000000;
+}
+
+/* Method to check the status og an exited task */
+static void checkStatus(flush_ctx *ctx, int pid, int status, char *input) {
+    input[strcspn(input, "\n")] = 0;
+
+    if (ctx->callback != NULL) {
+        ctx->callback(ctx, pid, input, status, ctx->callbackData);
+    }
+    if ((WIFEXITED(status) || WIFSIGNALED(status)) && !(ctx->flags & FLUSH_QUIET)) {
+        int exitStatus = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+        dprintf(ctx->fds[1], "exit status [%s] = %d\n", input, exitStatus);
+    }
+}
+
+/* Method to add a node to the linked list*/
+static void addProcess(flush_ctx *ctx, int pid, char *name) {
+    struct linkedProcess *newProcess = (struct linkedProcess*) malloc(sizeof(struct linkedProcess));
+
+    /* Updates the values */
+    newProcess->pid = pid;
+    strcpy(newProcess->name, name);
+    newProcess->quiet = 0;
+    newProcess->deadline = 0;
+    newProcess->killAfter = 0;
+    newProcess->timedOut = 0;
+    newProcess->started = getMilliseconds();
+    newProcess->lastSample = newProcess->started;
+    newProcess->lastTicks = 0;
+    newProcess->tree = NULL;
+    newProcess->treeCount = 0;
+
+    /* Updates the previous pointer */
+    newProcess->previous = ctx->tail;
+    if (ctx->tail != NULL) {
+        ctx->tail->next = newProcess;
+    }
+    ctx->tail = newProcess;
+
+    /* Updates the next pointer */
+    newProcess->next = NULL;
+    if (ctx->head == NULL) {
+        ctx->head = newProcess;
+    }
+}
+
+/* Prints all nodes in the linked list. The method is called as the promt "jobs" */
+static void printAllProcesses(flush_ctx *ctx) {
+    struct linkedProcess *process = ctx->head;
+    while (process != NULL) {
+        dprintf(ctx->fds[1], "[pid %d] %s\n", process->pid, process->name);
+        process = process->next;
+    } 
+}
+
+/* Method to close the /proc files of a process */
+static void closeProcFiles(struct procFiles *files) {
+    int fds[3] = { files->statFd, files->ioFd, files->childrenFd };
+    for (int i = 0; i < 3; i++) {
+        if (fds[i] != -1) {
+            close(fds[i]);
+        }
+    }
+}
+
+/* Method to remove a given process from the linked list */
+static void removeProcess(flush_ctx *ctx, struct linkedProcess *process) {
+    for (int i = 0; i < process->treeCount; i++) {
+        closeProcFiles(&process->tree[i]);
+    }
+    free(process->tree);
+
+    /* Checks if the linked process is the first process */
+    if (process->previous != NULL) {
+        process->previous->next = process->next;
+    }
+    else {
+        ctx->head = process->next;
+    }
+
+    /* Checks if the linked process is the last node */
+    if (process->next != NULL) {
+        process->next->previous = process->previous;
+    }
+    else {
+        ctx->tail = process->previous;
+    }
+
+    free(process);
+}
+
+/* Method to set the timer to the earliest deadline in the linked list, or to turn it off */
+static void armTimer(flush_ctx *ctx) {
+    struct itimerspec spec = { 0 };
+    long long next = 0;
+
+    for (struct linkedProcess *process = ctx->head; process != NULL; process = process->next) {
+        if (process->deadline != 0 && (next == 0 || process->deadline < next)) {
+            next = process->deadline;
+        }
+    }
+    spec.it_value.tv_sec = next / 1000;
+    spec.it_value.tv_nsec = next % 1000 * 1000000;
+    timerfd_settime(ctx->timerFd, TFD_TIMER_ABSTIME, &spec, NULL);
+}
+
+/* Method to signal the processes whose deadline has passed. They get SIGTERM first, and SIGKILL when
+ * they are still running after their kill-after time. The zygote reaps its children at once, so the
+ * exit statuses it has sent are read first, and a process already reaped is never signalled since its
+ * pid may belong to another process by now */
+static void enforceDeadlines(flush_ctx *ctx) {
+    uint64_t expirations;
+    long long now = getMilliseconds();
+
+    if (read(ctx->timerFd, &expirations, sizeof(expirations)) == -1 && errno != EAGAIN) {
+        printError(ctx, "flush: timer error\n");
+    }
+    drainZygote(ctx);
+    for (struct linkedProcess *process = ctx->head; process != NULL; process = process->next) {
+        if (process->deadline == 0 || process->deadline > now || isReaped(ctx, process->pid)) {
+            continue;
+        }
+        if (!process->timedOut) {
+            kill(process->pid, SIGTERM);
+            process->timedOut = SIGTERM;
+            process->deadline = process->killAfter != 0 ? now + process->killAfter : 0;
+        }
+        else {
+            kill(process->pid, SIGKILL);
+            process->timedOut = SIGKILL;
+            process->deadline = 0;
+        }
+    }
+    armTimer(ctx);
+}
+
+/* Method to check whether any process in the linked list has a deadline */
+static int hasDeadlines(flush_ctx *ctx) {
+    for (struct linkedProcess *process = ctx->head; process != NULL; process = process->next) {
+        if (process->deadline != 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Method to report a process stopped by its deadline with exit code 124, like timeout(1) */
+static int getTimeoutStatus(struct linkedProcess *process, int status) {
+    if (process->timedOut == SIGTERM && WIFSIGNALED(status) && WTERMSIG(status) == SIGTERM) {
+        return W_EXITCODE(124, 0);
+    }
+    return status;
+}
+
+/* Method to close every descriptor from 3 up, except the count descriptors in keep */
+static void closeOtherFds(int *keep, int count) {
+    int from = 3;
+
+    /* Sorts the descriptors to keep, so that the ones between them are closed as ranges */
+    for (int i = 1; i < count; i++) {
+        for (int j = i; j > 0 && keep[j - 1] > keep[j]; j--) {
+            int fd = keep[j];
+            keep[j] = keep[j - 1];
+            keep[j - 1] = fd;
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        if (keep[i] < from) {
+            continue;
+        }
+        if (keep[i] > from) {
+            close_range(from, keep[i] - 1, 0);
+        }
+        from = keep[i] + 1;
+    }
+    close_range(from, ~0U, 0);
+}
+
+/* Method to turn a forked child into a subshell. It gets no zygote and an empty job list with its own
+ * timer, so that it does not reap or signal the jobs of the shell. A subshell never execs, so it closes
+ * every descriptor it inherited except its own, or it would hold the files of other sessions open */
+static void enterSubshell(flush_ctx *ctx) {
+    resetSignals();
+    if (ctx->zygoteSocket != -1) {
+        close(ctx->zygoteSocket);
+        ctx->zygoteSocket = -1;
+    }
+    while (ctx->head != NULL) {
+        removeProcess(ctx, ctx->head);
+    }
+    while (ctx->reaped != NULL) {
+        struct reapedProcess *next = ctx->reaped->next;
+        free(ctx->reaped);
+        ctx->reaped = next;
+    }
+    close(ctx->timerFd);
+    ctx->timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+    /* A subshell may block on its output, so its messages go where its commands write */
+    ctx->fds[1] = ctx->jobFds[1];
+    ctx->fds[2] = ctx->jobFds[2];
+
+    int keep[] = { ctx->fds[0], ctx->fds[1], ctx->fds[2], ctx->jobFds[0], ctx->jobFds[1], ctx->jobFds[2],
+        ctx->cwd, ctx->timerFd };
+    closeOtherFds(keep, sizeof(keep) / sizeof(keep[0]));
+}
+
+/* Method run by the zygote child. It forks the requested commands from its own small image */
+static void zygoteSpawn(int sock, char *buffer, int length, int *fds) {
+    int argc, envc;
+    char *argv[MAXLEN + 1];
+    char **envp;
+    char *str = buffer + 2 * sizeof(int);
+    struct zygoteReply reply = { ZYGOTE_SPAWNED, -1, 0 };
+
+    /* Unpacks the argument and environment strings from the request */
+    memcpy(&argc, buffer, sizeof(int));
+    memcpy(&envc, buffer + sizeof(int), sizeof(int));
+    envp = malloc((envc + 1) * sizeof(char *));
+    if (argc > 0 && argc <= MAXLEN && envp != NULL) {
+        for (int i = 0; i < argc + envc && str < buffer + length; i++) {
+            if (i < argc) {
+                argv[i] = str;
+            }
+            else {
+                envp[i - argc] = str;
+            }
+            str += strlen(str) + 1;
+        }
+        argv[argc] = NULL;
+        envp[envc] = NULL;
+
+        reply.pid = fork();
+        if (reply.pid == 0) {
+            sigset_t mask;
+            sigemptyset(&mask);
+            sigprocmask(SIG_SETMASK, &mask, NULL);
+
+            for (int i = 0; i < 3; i++) {
+                dup2(fds[i], i);
+            }
+            if (fchdir(fds[3]) == -1) {
+                perror("flush: cd error\n");
+            }
+            for (int i = 0; i < 4; i++) {
+                if (fds[i] > 2) {
+                    close(fds[i]);
+                }
+            }
+
+            /* Exectute the command */
+            environ = envp;
+            if (execvp(argv[0], argv) == -1) {
+                perror("flush: execvp error\n");
+            }
+            _exit(1);
+        }
+    }
+    free(envp);
+
+    for (int i = 0; i < 4; i++) {
+        close(fds[i]);
+    }
+    send(sock, &reply, sizeof(reply), 0);
+}
+
+/* Method that runs the zygote in a loop. It waits for spawn requests and for exited children */
+static void runZygote(int sock) {
+    static char buffer[ZYGOTE_BUFLEN];
+    sigset_t mask;
+    struct signalfd_siginfo info;
+
+    /* SIGCHLD is read from a signalfd so that the zygote only wakes up when there is work */
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+    int sfd = signalfd(-1, &mask, SFD_CLOEXEC);
+
+    struct pollfd pfds[2] = { { sock, POLLIN, 0 }, { sfd, POLLIN, 0 } };
+    while (1) {
+        if (poll(pfds, 2, -1) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            _exit(1);
+        }
+
+        /* Reports every exited child to the shell */
+        if (pfds[1].revents & POLLIN) {
+            struct zygoteReply reply = { ZYGOTE_EXITED, 0, 0 };
+            read(sfd, &info, sizeof(info));
+            while ((reply.pid = waitpid(-1, &reply.status, WNOHANG)) > 0) {
+                send(sock, &reply, sizeof(reply), 0);
+            }
+        }
+
+        if (pfds[0].revents & (POLLIN | POLLHUP)) {
+            int fds[4];
+            char control[CMSG_SPACE(sizeof(fds))];
+            struct iovec iov = { buffer, sizeof(buffer) };
+            struct msghdr msg = { 0 };
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+
+            /* The shell closing its end of the socket shuts the zygote down */
+            ssize_t length = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+            if (length <= 0) {
+                _exit(0);
+            }
+
+            struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+            if (cmsg == NULL || cmsg->cmsg_type != SCM_RIGHTS
+                    || cmsg->cmsg_len != CMSG_LEN(sizeof(fds)) || length < 2 * (ssize_t) sizeof(int)) {
+                struct zygoteReply reply = { ZYGOTE_SPAWNED, -1, 0 };
+                send(sock, &reply, sizeof(reply), 0);
+                continue;
+            }
+            memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+            zygoteSpawn(sock, buffer, length, fds);
+        }
+    }
+}
+
+/* Method to start the zygote. It is forked before the shell grows, so every later fork is cheap */
+static void startZygote(flush_ctx *ctx) {
+    int sv[2];
+
+    /* Every context packs its spawn requests in its own buffer */
+    ctx->zygoteBuffer = malloc(ZYGOTE_BUFLEN);
+    if (ctx->zygoteBuffer == NULL || socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) == -1) {
+        printError(ctx, "flush: zygote error\n");
+        return;
+    }
+
+    /* The zygote must not write out a second copy of what the program has buffered */
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid < 0) {
+        printError(ctx, "flush: fork error\n");
+        close(sv[0]);
+        close(sv[1]);
+        return;
+    }
+
+    /* The zygote keeps only its end of the socket, so that other contexts still see their zygotes exit */
+    if (pid == 0) {
+        for (int fd = 3; fd < sysconf(_SC_OPEN_MAX) && fd < 65536; fd++) {
+            if (fd != sv[1]) {
+                close(fd);
+            }
+        }
+        runZygote(sv[1]);
+        _exit(0);
+    }
+    close(sv[1]);
+    ctx->zygoteSocket = sv[0];
+}
+
+/* Method to store an exit status from the zygote until it is collected */
+static void addReaped(flush_ctx *ctx, int pid, int status) {
+    struct reapedProcess *process = (struct reapedProcess*) malloc(sizeof(struct reapedProcess));
+    process->pid = pid;
+    process->status = status;
+    process->next = ctx->reaped;
+    ctx->reaped = process;
+}
+
+/* Method to read one reply from the zygote. Returns 0 if there is nothing to read without blocking */
+static int readZygoteReply(flush_ctx *ctx, struct zygoteReply *reply, int block) {
+    while (1) {
+        ssize_t length = recv(ctx->zygoteSocket, reply, sizeof(*reply), block ? 0 : MSG_DONTWAIT);
+        if (length == sizeof(*reply)) {
+            return 1;
+        }
+        if (length == -1 && errno == EINTR) {
+            continue;
+        }
+        if (length == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return 0;
+        }
+        printError(ctx, "flush: zygote error\n");
+        return -1;
+    }
+}
+
+/* Method to store every exit status the zygote has sent, without blocking */
+static void drainZygote(flush_ctx *ctx) {
+    struct zygoteReply reply;
+    while (ctx->zygoteSocket != -1 && readZygoteReply(ctx, &reply, 0) == 1) {
+        if (reply.type == ZYGOTE_EXITED) {
+            addReaped(ctx, reply.pid, reply.status);
+        }
+    }
+}
+
+/* Method to check whether the zygote has reported a child as exited and it is not collected yet */
+static int isReaped(flush_ctx *ctx, int pid) {
+    for (struct reapedProcess *process = ctx->reaped; process != NULL; process = process->next) {
+        if (process->pid == pid) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Method to ask the zygote to run a command. Returns the pid of the child, or -1 on error */
+static int spawnWithZygote(flush_ctx *ctx, char **args, int *fds) {
+    char *buffer = ctx->zygoteBuffer;
+    int argc = 0, envc = 0, length = 2 * sizeof(int);
+
+    /* Packs argv and the environment as a sequence of strings after the two counts */
+    for (char **str = args; *str != NULL; str++, argc++) {
+        int size = strlen(*str) + 1;
+        if (length + size > ZYGOTE_BUFLEN) {
+            errno = E2BIG;
+            return -1;
+        }
+        memcpy(buffer + length, *str, size);
+        length += size;
+    }
+    for (char **str = getEnviron(ctx); *str != NULL; str++, envc++) {
+        int size = strlen(*str) + 1;
+        if (length + size > ZYGOTE_BUFLEN) {
+            errno = E2BIG;
+            return -1;
+        }
+        memcpy(buffer + length, *str, size);
+        length += size;
+    }
+    memcpy(buffer, &argc, sizeof(int));
+    memcpy(buffer + sizeof(int), &envc, sizeof(int));
+
+    /* Passes stdin, stdout, stderr and the current directory along with the request */
+    int sendFds[4] = { fds[0], fds[1], fds[2], openat(getDirFd(ctx), ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC) };
+    if (sendFds[3] == -1) {
+        printError(ctx, "flush: cwd error\n");
+        return -1;
+    }
+    char control[CMSG_SPACE(sizeof(sendFds))];
+    struct iovec iov = { buffer, length };
+    struct msghdr msg = { 0 };
+    memset(control, 0, sizeof(control));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(sendFds));
+    memcpy(CMSG_DATA(cmsg), sendFds, sizeof(sendFds));
+
+    ssize_t sent = sendmsg(ctx->zygoteSocket, &msg, 0);
+    close(sendFds[3]);
+    if (sent == -1) {
+        printError(ctx, "flush: zygote error\n");
+        return -1;
+    }
+
+    /* Exit statuses that arrive before the reply are kept for later */
+    struct zygoteReply reply;
+    while (readZygoteReply(ctx, &reply, 1) == 1) {
+        if (reply.type == ZYGOTE_SPAWNED) {
+            return reply.pid;
+        }
+        addReaped(ctx, reply.pid, reply.status);
+    }
+    return -1;
+}
+
+/* Method to check whether a child was forked by the shell itself and not by the zygote */
+static int isOwnChild(flush_ctx *ctx, int pid) {
+    siginfo_t info;
+    return ctx->zygoteSocket == -1 || waitid(P_PID, pid, &info, WEXITED | WNOHANG | WNOWAIT) == 0;
+}
+
+/* Method to wait for a child. Works like waitpid, but also for children forked by the zygote */
+static int reapProcess(flush_ctx *ctx, int pid, int *status, int options) {
+    if (isOwnChild(ctx, pid)) {
+        return waitpid(pid, status, options);
+    }
+
+    while (1) {
+        /* Checks the exit statuses already received from the zygote */
+        struct reapedProcess **process = &ctx->reaped;
+        while (*process != NULL) {
+            if ((*process)->pid == pid) {
+                struct reapedProcess *found = *process;
+                *status = found->status;
+                *process = found->next;
+                free(found);
+                return pid;
+            }
+            process = &(*process)->next;
+        }
+
+        struct zygoteReply reply;
+        int result = readZygoteReply(ctx, &reply, !(options & WNOHANG));
+        if (result <= 0) {
+            return result;
+        }
+        if (reply.type == ZYGOTE_EXITED) {
+            addReaped(ctx, reply.pid, reply.status);
+        }
+    }
+}
+
+/* Method to wait until one of the given children exits. Returns its pid, or -1 on error. It polls a
+ * pidfd for each of the shell's own children and the zygote socket for the rest, so that other
+ * children of the shell are left alone. Deadlines that pass during the wait are enforced */
+static int reapAny(flush_ctx *ctx, int *pids, int count, int *status) {
+    while (1) {
+        struct pollfd pfds[count + 2];
+        int waiting = 0, result = 0, timer = -1;
+
+        for (int i = 0; i < count && result == 0; i++) {
+            if ((result = reapProcess(ctx, pids[i], status, WNOHANG)) != 0) {
+                result = result > 0 ? pids[i] : -1;
+            }
+            else if (isOwnChild(ctx, pids[i])) {
+                pfds[waiting].fd = syscall(SYS_pidfd_open, pids[i], 0);
+                pfds[waiting].events = POLLIN;
+                if (pfds[waiting].fd == -1) {
+                    result = waitpid(pids[i], status, 0);
+                }
+                else {
+                    waiting++;
+                }
+            }
+        }
+
+        if (result == 0) {
+            if (ctx->zygoteSocket != -1) {
+                pfds[waiting].fd = ctx->zygoteSocket;
+                pfds[waiting++].events = POLLIN;
+            }
+            timer = waiting;
+            pfds[waiting].fd = ctx->timerFd;
+            pfds[waiting++].events = POLLIN;
+            while (poll(pfds, waiting, -1) == -1 && errno == EINTR) {
+            }
+            if (pfds[timer].revents & POLLIN) {
+                enforceDeadlines(ctx);
+            }
+        }
+
+        for (int i = 0; i < waiting; i++) {
+            if (pfds[i].fd != ctx->zygoteSocket && i != timer) {
+                close(pfds[i].fd);
+            }
+        }
+        if (result != 0) {
+            return result;
+        }
+    }
+}
+
+/* Method to check for complete processes. If a process is teminated it gets removed */
+static void checkForCompleteProcesses(flush_ctx *ctx) {
+    struct linkedProcess *process = ctx->head;
+    while (process != NULL) {
+        int status;
+        struct linkedProcess *next = process->next;
+
+        /* Checks if processes are complete */
+        if (reapProcess(ctx, process->pid, &status, WNOHANG) > 0) {
+            if (!process->quiet) {
+                checkStatus(ctx, process->pid, getTimeoutStatus(process, status), process->name);
+            }
+            removeProcess(ctx, process);
+        }
+        process = next;
+    }
+
+    /* Deadlines are enforced only on the processes that are still running */
+    enforceDeadlines(ctx);
+}
+
+/* Method to wait for a child in the foreground. While any process has a deadline, it waits in poll() on
+ * the child and the timer, so that deadlines are enforced during the wait */
+static int waitForeground(flush_ctx *ctx, int pid, int *status) {
+    if (hasDeadlines(ctx)) {
+        return reapAny(ctx, &pid, 1, status);
+    }
+    return reapProcess(ctx, pid, status, 0);
+}
+
+/* Method to parse a string into args. The operators ';', '&&', '||' and '&' become args of their own,
+ * so buffer needs room for twice the length of str */
+static void parseString(const char *str, char *buffer, char **args) {
+    int count = 0;
+
+    while (*str != '\0' && count < MAXLEN - 1) {
+        if (*str == ' ' || *str == '\t' || *str == '\n') {
+            str++;
+            continue;
+        }
+
+        args[count++] = buffer;
+        if ((str[0] == '&' && str[1] == '&') || (str[0] == '|' && str[1] == '|')) {
+            *buffer++ = *str++;
+            *buffer++ = *str++;
+        }
+        else if (*str == ';' || *str == '&') {
+            *buffer++ = *str++;
+        }
+        else if ((str[0] == '<' || str[0] == '>') && str[1] == '(') {
+            /* A process substitution is one arg up to its matching ')' */
+            int depth = 0;
+            *buffer++ = *str++;
+            do {
+                depth += (*str == '(') - (*str == ')');
+                *buffer++ = *str++;
+            } while (*str != '\0' && depth > 0);
+        }
+        else {
+            while (*str != '\0' && strchr(" \t\n;&", *str) == NULL
+                    && !(str[0] == '|' && str[1] == '|')) {
+                *buffer++ = *str++;
+            }
+        }
+        *buffer++ = '\0';
+    }
+    args[count] = NULL;
+}
+
+/* Method to check whether a task is to be executed as a background task */
+static int checkIfBackgroundTask(char input[MAXLEN]) {
+    /* Removes newline from input string */
+    input[strcspn(input, "\n")] = 0;
+    int length = strlen(input) - 1;
+
+    /* Checks for '&' and removes it from string */
+    int check = input[length] == '&';
+    if ((length > 0) && (input[length] == '&')) {
+        input[length] = '\0';
+        length--;
+    }
+    /* Removes trailing whitespaces after removing '&' */
+    while (length > -1) {
+        if (input[length] == ' ' || input[length] == '\t') {
+            length--;
+        }
+        else {
+            break;
+        }
+        input[length + 1] = '\0';
+    }
+    return check;
+} 
+
+/* Method to check whether an arg is a process substitution, "<(command)" or ">(command)" */
+static int isSubstitution(const char *arg) {
+    return (arg[0] == '<' || arg[0] == '>') && arg[1] == '(';
+}
+
+/* Method for I/O redirection. Parses args for '<' or '>' and filename, and opens the files into fds */
+static int openRedirections(flush_ctx *ctx, char **args, int *fds) {
+    int index = 0, fd;
+
+    while (args[index]) {
+        if (isSubstitution(args[index])) {
+            index++;
+            continue;
+        }
+        if (*args[index] == '>' && args[index+1]) {
+            if ((fd = openat(getDirFd(ctx), args[index+1],
+                        O_WRONLY | O_CREAT | O_CLOEXEC,
+                        S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH)) == -1) {
+                printError(ctx, args[index+1]);
+                return -1;
+            }
+            if (fds[1] != ctx->jobFds[1]) {
+                close(fds[1]);
+            }
+            fds[1] = fd;
+            fds[2] = fd;
+        }
+        else if (*args[index] == '<' && args[index+1]) {
+            if ((fd = openat(getDirFd(ctx), args[index+1], O_RDONLY | O_CLOEXEC)) == -1) {
+                printError(ctx, args[index+1]);
+                return -1;
+            }
+            if (fds[0] != ctx->jobFds[0]) {
+                close(fds[0]);
+            }
+            fds[0] = fd;
+        }
+        else {
+            index++;
+            continue;
+        }
+
+        /* Adjust the rest of the arguments in the array */
+        for (int i = index; args[i]; i++) {
+            args[i] = args[i+2];
+        }
+    }
+    return 0;
+}
+
+/* Method to close the files opened by openRedirections */
+static void closeRedirections(flush_ctx *ctx, int *fds) {
+    if (fds[0] != ctx->jobFds[0]) {
+        close(fds[0]);
+        fds[0] = ctx->jobFds[0];
+    }
+    if (fds[1] != ctx->jobFds[1]) {
+        close(fds[1]);
+        fds[1] = ctx->jobFds[1];
+        fds[2] = ctx->jobFds[2];
+    }
+}
+
+/* Method to start the process substitutions in args. Each one runs in a subshell connected to a pipe,
+ * and its arg is replaced by the /dev/fd path of the other end. Returns -1 on error */
+static int startSubstitutions(flush_ctx *ctx, char **args, struct substitutions *subs) {
+    subs->count = 0;
+    subs->fds[0] = -1;
+
+    for (int index = 0; args[index] != NULL; index++) {
+        char *arg = args[index];
+        int length = strlen(arg), pipeFds[2];
+        if (!isSubstitution(arg)) {
+            continue;
+        }
+        if (arg[length - 1] != ')') {
+            dprintf(ctx->fds[1], "flush: syntax error, missing ')'\n");
+            return -1;
+        }
+        if (subs->count == SUBST_MAX) {
+            dprintf(ctx->fds[1], "flush: too many process substitutions\n");
+            return -1;
+        }
+
+        /* The command reads from <(...) and writes to >(...) */
+        int output = arg[0] == '<';
+        if (pipe2(pipeFds, O_CLOEXEC) == -1) {
+            printError(ctx, "flush: pipe error\n");
+            return -1;
+        }
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid < 0) {
+            printError(ctx, "flush: fork error\n");
+            close(pipeFds[0]);
+            close(pipeFds[1]);
+            return -1;
+        }
+        if (pid == 0) {
+            /* The subshell keeps only its own end of the pipe, so the command sees EOF when it is done */
+            ctx->fds[output ? 1 : 0] = pipeFds[output ? 1 : 0];
+            ctx->jobFds[output ? 1 : 0] = pipeFds[output ? 1 : 0];
+            enterSubshell(ctx);
+            ctx->flags |= FLUSH_QUIET;
+            ctx->callback = NULL;
+
+            arg[length - 1] = '\0';
+            int status = flush_exec(ctx, arg + 2);
+            fflush(stdout);
+            _exit(status);
+        }
+
+        close(pipeFds[output ? 1 : 0]);
+        subs->names[subs->count] = arg;
+        subs->pids[subs->count] = pid;
+        subs->fds[subs->count] = pipeFds[output ? 0 : 1];
+        snprintf(subs->paths[subs->count], sizeof(subs->paths[0]), "/dev/fd/%d", subs->fds[subs->count]);
+        args[index] = subs->paths[subs->count];
+        subs->fds[++subs->count] = -1;
+    }
+    return 0;
+}
+
+/* Method to close the pipes of the process substitutions, once the command has its own copies */
+static void closeSubstitutions(struct substitutions *subs) {
+    for (int i = 0; i < subs->count; i++) {
+        close(subs->fds[i]);
+    }
+    subs->fds[0] = -1;
+}
+
+/* Method to collect the subshells of the process substitutions. The ones that are done are reaped, and
+ * the rest become jobs that are reaped later, so that they do not hold up the prompt. The subshells of
+ * a foreground command stay quiet like the command's own part, while those of a background command
+ * are all reported as jobs */
+static void finishSubstitutions(flush_ctx *ctx, struct substitutions *subs, int background) {
+    int status;
+    for (int i = 0; i < subs->count; i++) {
+        if (!background && reapProcess(ctx, subs->pids[i], &status, WNOHANG) > 0) {
+            continue;
+        }
+        char name[MAXLEN];
+        snprintf(name, sizeof(name), "%s", subs->names[i]);
+        addProcess(ctx, subs->pids[i], name);
+        ctx->tail->quiet = !background;
+    }
+    subs->count = 0;
+}
+
+/* Method to start a command with the given stdin, stdout and stderr. inherit lists more descriptors that
+ * the command keeps under the same numbers, followed by -1. Returns the pid, or -1 on error */
+static int spawnCommand(flush_ctx *ctx, char **args, int *fds, const int *inherit) {
+    fflush(stdout);
+
+    /* The zygote cannot keep descriptor numbers, so commands with inherited descriptors are forked here */
+    if (ctx->zygoteSocket != -1 && (inherit == NULL || inherit[0] == -1)) {
+        return spawnWithZygote(ctx, args, fds);
+    }
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        resetSignals();
+        for (int i = 0; i < 3; i++) {
+            dup2(fds[i], i);
+        }
+        for (int i = 0; inherit != NULL && inherit[i] != -1; i++) {
+            fcntl(inherit[i], F_SETFD, 0);
+        }
+        setrlimit(RLIMIT_NOFILE, &ctx->fileLimit);
+        if (ctx->cwd != -1 && fchdir(ctx->cwd) == -1) {
+            perror("flush: cd error\n");
+        }
+        environ = getEnviron(ctx);
+
+        /* Exectute the command */
+        if (execvp(args[0], args) == -1) {
+            perror("flush: execvp error\n");
+        }
+        _exit(1);
+    }
+    return pid;
+}
+
+/* Method to turn a status from waitpid into a shell exit code */
+static int exitCode(int status) {
+    if (WIFSIGNALED(status)) {
+        return 128 + WTERMSIG(status);
+    }
+    return WEXITSTATUS(status);
+}
+
+/* Method to add bytes to a 64 bit FNV-1a hash */
+static void hashBytes(uint64_t *hash, const void *data, size_t length) {
+    const unsigned char *bytes = data;
+    for (size_t i = 0; i < length; i++) {
+        *hash ^= bytes[i];
+        *hash *= 1099511628211ULL;
+    }
+}
+
+/* Method to add a file to the hash, either by its contents or by its size and mtime */
+static int hashFile(uint64_t *hash, int fd, int useMtime) {
+    if (useMtime) {
+        struct stat st;
+        if (fstat(fd, &st) == -1) {
+            return -1;
+        }
+        hashBytes(hash, &st.st_size, sizeof(st.st_size));
+        hashBytes(hash, &st.st_mtim, sizeof(st.st_mtim));
+        return 0;
+    }
+
+    char buffer[CACHE_BUFLEN];
+    ssize_t length;
+    while ((length = read(fd, buffer, sizeof(buffer))) > 0) {
+        hashBytes(hash, buffer, length);
+    }
+
+    /* Rewinds the file so the command can read it afterwards */
+    if (length == -1 || lseek(fd, 0, SEEK_SET) == -1) {
+        return -1;
+    }
+    return 0;
+}
+
+/* Method to find the cache directory, $FLUSH_CACHE_DIR or ~/.cache/flush, and create it if needed */
+static int getCacheDir(flush_ctx *ctx, char *dir) {
+    char *path = getVariable(ctx, "FLUSH_CACHE_DIR");
+    if (path != NULL) {
+        snprintf(dir, MAXLEN, "%s", path);
+    }
+    else {
+        char *home = getVariable(ctx, "HOME");
+        if (home == NULL) {
+            dprintf(ctx->fds[1], "flush: no cache directory, set FLUSH_CACHE_DIR\n");
+            return -1;
+        }
+        snprintf(dir, MAXLEN, "%s/.cache", home);
+        mkdir(dir, S_IRWXU);
+        snprintf(dir, MAXLEN, "%s/.cache/flush", home);
+    }
+
+    if (mkdir(dir, S_IRWXU) == -1 && errno != EEXIST) {
+        printError(ctx, dir);
+        return -1;
+    }
+    return 0;
+}
+
+/* Method to compare cache entries by when they were last used, oldest first */
+static int compareCacheEntries(const void *a, const void *b) {
+    const struct cacheEntry *first = a, *second = b;
+    if (first->used.tv_sec != second->used.tv_sec) {
+        return first->used.tv_sec < second->used.tv_sec ? -1 : 1;
+    }
+    if (first->used.tv_nsec != second->used.tv_nsec) {
+        return first->used.tv_nsec < second->used.tv_nsec ? -1 : 1;
+    }
+    return 0;
+}
+
+/* Method to remove the least recently used entries until the cache is within $FLUSH_CACHE_SIZE bytes */
+static void evictCache(flush_ctx *ctx, char *dir) {
+    long long limit = CACHE_MAXSIZE;
+    char *size = getVariable(ctx, "FLUSH_CACHE_SIZE");
+    if (size != NULL) {
+        limit = strtoll(size, NULL, 10);
+    }
+
+    DIR *stream = opendir(dir);
+    if (stream == NULL) {
+        printError(ctx, dir);
+        return;
+    }
+
+    /* Collects every finished entry. Temporary files from running commands are skipped */
+    struct cacheEntry *entries = NULL;
+    int count = 0, capacity = 0;
+    long long total = 0;
+    struct dirent *dirent;
+    while ((dirent = readdir(stream)) != NULL) {
+        struct stat st;
+        if (strlen(dirent->d_name) != 16 || fstatat(dirfd(stream), dirent->d_name, &st, 0) == -1) {
+            continue;
+        }
+        if (count == capacity) {
+            capacity = capacity ? 2 * capacity : 64;
+            entries = realloc(entries, capacity * sizeof(struct cacheEntry));
+        }
+        strcpy(entries[count].name, dirent->d_name);
+        entries[count].size = st.st_size;
+        entries[count].used = st.st_mtim;
+        total += st.st_size;
+        count++;
+    }
+
+    qsort(entries, count, sizeof(struct cacheEntry), compareCacheEntries);
+    for (int i = 0; i < count && total > limit; i++) {
+        if (unlinkat(dirfd(stream), entries[i].name, 0) == 0) {
+            total -= entries[i].size;
+        }
+    }
+    free(entries);
+    closedir(stream);
+}
+
+/* Method to copy the rest of one file into another */
+static int copyFile(int from, int to) {
+    char buffer[CACHE_BUFLEN];
+    ssize_t length;
+    while ((length = read(from, buffer, sizeof(buffer))) > 0) {
+        for (ssize_t written = 0, n; written < length; written += n) {
+            if ((n = write(to, buffer + written, length - written)) == -1) {
+                return -1;
+            }
+        }
+    }
+    return length;
+}
+
+/* Method for the "cache" prefix. Replays the stored output and exit status when the command has run
+ * with the same arguments, environment, input and dependency files before, and stores it otherwise */
+static int cacheCommand(flush_ctx *ctx, char **args, char *input) {
+    char *deps[MAXLEN];
+    int depCount = 0, useMtime = 0, status, pid = 0;
+    int fds[3] = { ctx->jobFds[0], ctx->jobFds[1], ctx->jobFds[2] };
+    uint64_t hash = 14695981039346656037ULL;
+    char dir[MAXLEN], path[MAXLEN + 20], tmpPath[MAXLEN + 40], header[CACHE_HEADERLEN + 1];
+
+    input[strcspn(input, "\n")] = 0;
+
+    /* Parses the options in front of the command. -d adds a dependency, -m uses mtimes instead of contents */
+    while (*args != NULL && **args == '-') {
+        if (strcmp(*args, "-m") == 0) {
+            useMtime = 1;
+        }
+        else if (strcmp(*args, "-d") == 0 && args[1] != NULL) {
+            deps[depCount++] = *++args;
+        }
+        else {
+            break;
+        }
+        args++;
+    }
+    if (*args == NULL || **args == '-') {
+        dprintf(ctx->fds[1], "flush: usage: cache [-m] [-d file]... command\n");
+        return 1;
+    }
+
+    if (openRedirections(ctx, args, fds) == -1 || getCacheDir(ctx, dir) == -1) {
+        closeRedirections(ctx, fds);
+        return 1;
+    }
+
+    /* Builds the key from argv, the variables named in $FLUSH_CACHE_ENV, the input file and the dependencies */
+    for (char **str = args; *str != NULL; str++) {
+        hashBytes(&hash, *str, strlen(*str) + 1);
+    }
+    char names[MAXLEN], *saveptr;
+    snprintf(names, sizeof(names), "%s", getVariable(ctx, "FLUSH_CACHE_ENV") ? getVariable(ctx, "FLUSH_CACHE_ENV") : "PATH");
+    for (char *name = strtok_r(names, ":", &saveptr); name != NULL; name = strtok_r(NULL, ":", &saveptr)) {
+        char *value = getVariable(ctx, name);
+        hashBytes(&hash, name, strlen(name) + 1);
+        hashBytes(&hash, value ? value : "", value ? strlen(value) + 1 : 0);
+    }
+    if (fds[0] != ctx->jobFds[0] && hashFile(&hash, fds[0], useMtime) == -1) {
+        printError(ctx, "flush: cache error\n");
+        closeRedirections(ctx, fds);
+        return 1;
+    }
+    for (int i = 0; i < depCount; i++) {
+        int fd = openat(getDirFd(ctx), deps[i], O_RDONLY | O_CLOEXEC);
+        if (fd == -1 || hashFile(&hash, fd, useMtime) == -1) {
+            printError(ctx, deps[i]);
+            if (fd != -1) {
+                close(fd);
+            }
+            closeRedirections(ctx, fds);
+            return 1;
+        }
+        close(fd);
+    }
+    snprintf(path, sizeof(path), "%s/%016llx", dir, (unsigned long long) hash);
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd != -1) {
+        /* Cache hit. Touches the entry so that it counts as recently used */
+        int exitStatus;
+        futimens(fd, NULL);
+        if (read(fd, header, CACHE_HEADERLEN) != CACHE_HEADERLEN
+                || sscanf(header, "flush-cache %d", &exitStatus) != 1) {
+            dprintf(ctx->fds[1], "flush: broken cache entry %s is removed\n", path);
+            unlink(path);
+            close(fd);
+            closeRedirections(ctx, fds);
+            return 1;
+        }
+        status = W_EXITCODE(exitStatus, 0);
+    }
+    else {
+        /* Cache miss. Runs the command with its output written to a temporary entry after the header */
+        snprintf(tmpPath, sizeof(tmpPath), "%s.tmp.%d", path, getpid());
+        if ((fd = open(tmpPath, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR)) == -1) {
+            printError(ctx, tmpPath);
+            closeRedirections(ctx, fds);
+            return 1;
+        }
+        lseek(fd, CACHE_HEADERLEN, SEEK_SET);
+
+        int runFds[3] = { fds[0], fd, fds[2] == fds[1] ? fd : fds[2] };
+        pid = spawnCommand(ctx, args, runFds, NULL);
+        if (pid < 0) {
+            printError(ctx, "flush: fork error\n");
+            unlink(tmpPath);
+            close(fd);
+            closeRedirections(ctx, fds);
+            return 1;
+        }
+        waitForeground(ctx, pid, &status);
+
+        /* Only commands that exited normally are stored */
+        if (WIFEXITED(status)) {
+            snprintf(header, sizeof(header), CACHE_HEADER, WEXITSTATUS(status));
+            pwrite(fd, header, CACHE_HEADERLEN, 0);
+            rename(tmpPath, path);
+            evictCache(ctx, dir);
+        }
+        else {
+            unlink(tmpPath);
+        }
+    }
+
+    /* Replays the stored output */
+    fflush(stdout);
+    lseek(fd, CACHE_HEADERLEN, SEEK_SET);
+    if (copyFile(fd, fds[1]) == -1) {
+        printError(ctx, "flush: cache error\n");
+    }
+    close(fd);
+    closeRedirections(ctx, fds);
+    checkStatus(ctx, pid, status, input);
+    return exitCode(status);
+}
+
+/* Method to find a background task in the linked list by its pid */
+static struct linkedProcess *findProcess(flush_ctx *ctx, int pid) {
+    for (struct linkedProcess *process = ctx->head; process != NULL; process = process->next) {
+        if (process->pid == pid) {
+            return process;
+        }
+    }
+    return NULL;
+}
+
+/* Method to start a run of the on-change command through execute(). Returns its pid, or -1 on error */
+static int startOnChangeRun(flush_ctx *ctx, char **command) {
+    char *args[MAXLEN];
+    char input[MAXLEN];
+    int count = 0;
+
+    input[0] = '\0';
+    while (command[count] != NULL) {
+        args[count] = command[count];
+        if (strlen(input) + strlen(command[count]) + 4 < MAXLEN) {
+            strcat(input, count > 0 ? " " : "");
+            strcat(input, command[count]);
+        }
+        count++;
+    }
+    args[count] = NULL;
+    strcat(input, " &");
+
+    struct linkedProcess *last = ctx->tail;
+    execute(ctx, args, input);
+    return ctx->tail != last && ctx->tail != NULL ? ctx->tail->pid : -1;
+}
+
+/* Method to collect a finished run of the on-change command. Returns 1 if it is done */
+static int finishOnChangeRun(flush_ctx *ctx, int pid, int options) {
+    struct linkedProcess *process = findProcess(ctx, pid);
+    int status;
+
+    if (process == NULL) {
+        return 1;
+    }
+    if ((options & WNOHANG ? reapProcess(ctx, pid, &status, options) : waitForeground(ctx, pid, &status)) <= 0) {
+        return 0;
+    }
+    checkStatus(ctx, pid, status, process->name);
+    removeProcess(ctx, process);
+    return 1;
+}
+
+/* Method to add an inotify watch for a path. inotify only knows the directory of the process, so a
+ * relative path of a session is looked up through its directory in /proc */
+static int addWatch(flush_ctx *ctx, int ifd, const char *path) {
+    char fullPath[PATH_MAX];
+    if (ctx->cwd != -1 && path[0] != '/') {
+        if (snprintf(fullPath, sizeof(fullPath), "/proc/self/fd/%d/%s", ctx->cwd, path) >= (int) sizeof(fullPath)) {
+            errno = ENAMETOOLONG;
+            return -1;
+        }
+        path = fullPath;
+    }
+    return inotify_add_watch(ifd, path, ONCHANGE_EVENTS);
+}
+
+/* Method for the "on-change" builtin. Runs the command, and again whenever one of the paths changes.
+ * Events are read from inotify and coalesced until the paths have been quiet for the debounce time.
+ * A change during a run queues one more run, or with -k cancels the run and starts over. It stops on
+ * SIGINT or after -n runs, and sleeps in poll() while nothing happens */
+static int onChangeCommand(flush_ctx *ctx, char **args) {
+    int debounce = ONCHANGE_DEBOUNCE, cancel = 0, maxRuns = -1, runs = 0;
+    int pathCount = 0, wds[MAXLEN];
+    char **paths, **command = NULL;
+
+    /* Parses the options, the paths and the command after "--" */
+    while (*args != NULL && **args == '-' && strcmp(*args, "--") != 0) {
+        if (strcmp(*args, "-k") == 0) {
+            cancel = 1;
+        }
+        else if (strcmp(*args, "-d") == 0 && args[1] != NULL) {
+            debounce = atoi(*++args);
+        }
+        else if (strcmp(*args, "-n") == 0 && args[1] != NULL) {
+            maxRuns = atoi(*++args);
+        }
+        else {
+            break;
+        }
+        args++;
+    }
+    paths = args;
+    while (paths[pathCount] != NULL && strcmp(paths[pathCount], "--") != 0) {
+        pathCount++;
+    }
+    if (paths[pathCount] != NULL) {
+        command = paths + pathCount + 1;
+    }
+    if (pathCount == 0 || command == NULL || *command == NULL) {
+        dprintf(ctx->fds[1], "flush: usage: on-change [-k] [-d ms] [-n runs] path... -- command\n");
+        return 1;
+    }
+
+    int ifd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (ifd == -1) {
+        printError(ctx, "flush: inotify error\n");
+        return 1;
+    }
+    for (int i = 0; i < pathCount; i++) {
+        if ((wds[i] = addWatch(ctx, ifd, paths[i])) == -1) {
+            printError(ctx, paths[i]);
+            close(ifd);
+            return 1;
+        }
+    }
+
+    /* SIGINT stops the loop instead of the shell */
+    sigset_t mask, oldMask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigprocmask(SIG_BLOCK, &mask, &oldMask);
+    int sfd = signalfd(-1, &mask, SFD_CLOEXEC);
+
+    int pid = startOnChangeRun(ctx, command), queued = 0, running = 1;
+    long long lastEvent = -1;
+    while (running) {
+        struct pollfd pfds[4] = { { ifd, POLLIN, 0 }, { sfd, POLLIN, 0 }, { -1, POLLIN, 0 }, { ctx->timerFd, POLLIN, 0 } };
+        int timeout = -1;
+
+        /* Waits on a pidfd for the shell's own child, or on the zygote socket */
+        if (pid > 0) {
+            pfds[2].fd = isOwnChild(ctx, pid) ? syscall(SYS_pidfd_open, pid, 0) : ctx->zygoteSocket;
+        }
+        if (lastEvent != -1) {
+            timeout = lastEvent + debounce - getMilliseconds();
+            timeout = timeout < 0 ? 0 : timeout;
+        }
+        if (poll(pfds, 4, timeout) == -1 && errno != EINTR) {
+            printError(ctx, "flush: poll error\n");
+            running = 0;
+        }
+        if (pfds[2].fd != -1 && pfds[2].fd != ctx->zygoteSocket) {
+            close(pfds[2].fd);
+        }
+
+        if (pfds[3].revents & POLLIN) {
+            enforceDeadlines(ctx);
+        }
+        if (pfds[1].revents & POLLIN) {
+            struct signalfd_siginfo info;
+            read(sfd, &info, sizeof(info));
+            running = 0;
+        }
+
+        /* Reads every event. A watch that is removed, like when an editor replaces the file, is added again */
+        if (pfds[0].revents & POLLIN) {
+            char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+            ssize_t length;
+            while ((length = read(ifd, buffer, sizeof(buffer))) > 0) {
+                for (char *ptr = buffer; ptr < buffer + length; ) {
+                    struct inotify_event *event = (struct inotify_event *) ptr;
+                    for (int i = 0; i < pathCount && (event->mask & IN_IGNORED); i++) {
+                        if (wds[i] == event->wd) {
+                            wds[i] = addWatch(ctx, ifd, paths[i]);
+                        }
+                    }
+                    ptr += sizeof(struct inotify_event) + event->len;
+                }
+            }
+            lastEvent = getMilliseconds();
+        }
+
+        if (pid > 0 && finishOnChangeRun(ctx, pid, WNOHANG)) {
+            pid = -1;
+            runs++;
+            if (maxRuns != -1 && runs >= maxRuns) {
+                running = 0;
+            }
+        }
+
+        /* The paths have been quiet long enough, so the command runs again */
+        if (lastEvent != -1 && getMilliseconds() - lastEvent >= debounce) {
+            lastEvent = -1;
+            queued = 1;
+            if (pid > 0 && cancel) {
+                kill(pid, SIGTERM);
+            }
+        }
+        if (running && queued && pid <= 0) {
+            queued = 0;
+            for (int i = 0; i < pathCount; i++) {
+                if (wds[i] == -1) {
+                    wds[i] = addWatch(ctx, ifd, paths[i]);
+                }
+            }
+            pid = startOnChangeRun(ctx, command);
+        }
+    }
+
+    /* Stops a run that is still going */
+    if (pid > 0) {
+        kill(pid, SIGTERM);
+        finishOnChangeRun(ctx, pid, 0);
+    }
+    close(sfd);
+    close(ifd);
+    sigprocmask(SIG_SETMASK, &oldMask, NULL);
+    return 0;
+}
+
+/* Struct for the telemetry of a job, summed over its process tree */
+struct jobSample {
+    char state;
+    int processes;
+    unsigned long long ticks;
+    unsigned long long rss;
+    unsigned long long readBytes;
+    unsigned long long writeBytes;
+};
+
+/* Method to open the /proc files of a process. A file that cannot be opened is left at -1 */
+static void openProcFiles(struct procFiles *files, int pid) {
+    char path[64];
+
+    files->pid = pid;
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    files->statFd = open(path, O_RDONLY | O_CLOEXEC);
+    snprintf(path, sizeof(path), "/proc/%d/io", pid);
+    files->ioFd = open(path, O_RDONLY | O_CLOEXEC);
+    snprintf(path, sizeof(path), "/proc/%d/task/%d/children", pid, pid);
+    files->childrenFd = open(path, O_RDONLY | O_CLOEXEC);
+}
+
+/* Method to read a /proc file from an open descriptor. pread() starts at the top of the file, so the
+ * same descriptor is read again on every sample. Returns the length, or -1 once the process is gone */
+static int readProcFile(int fd, char *buffer, int size) {
+    if (fd == -1) {
+        return -1;
+    }
+    ssize_t length = pread(fd, buffer, size - 1, 0);
+    if (length < 0) {
+        return -1;
+    }
+    buffer[length] = '\0';
+    return length;
+}
+
+/* Method to update the process tree of a job. The files of processes that are still in the tree stay
+ * open, so only the processes that are new since the last sample are opened */
+static void updateProcTree(struct linkedProcess *process) {
+    struct procFiles *tree = malloc(JOBS_MAXTREE * sizeof(struct procFiles));
+    char buffer[JOBS_BUFLEN];
+    int count = 1;
+
+    if (tree == NULL) {
+        return;
+    }
+    tree[0].pid = process->pid;
+    for (int i = 0; i < count; i++) {
+        /* Takes the open files of the process from the last tree, or opens them */
+        int pid = tree[i].pid, found = 0;
+        for (int j = 0; j < process->treeCount && !found; j++) {
+            if (process->tree[j].pid == pid) {
+                tree[i] = process->tree[j];
+                process->tree[j].pid = 0;
+                found = 1;
+            }
+        }
+        if (!found) {
+            openProcFiles(&tree[i], pid);
+        }
+
+        /* Adds the children of the process to the end of the tree */
+        if (readProcFile(tree[i].childrenFd, buffer, sizeof(buffer)) > 0) {
+            char *str = buffer, *end;
+            long child;
+            while (count < JOBS_MAXTREE && (child = strtol(str, &end, 10)) > 0) {
+                tree[count++].pid = child;
+                str = end;
+            }
+        }
+    }
+
+    for (int j = 0; j < process->treeCount; j++) {
+        if (process->tree[j].pid != 0) {
+            closeProcFiles(&process->tree[j]);
+        }
+    }
+    free(process->tree);
+
+    /* The tree is built in room for JOBS_MAXTREE processes, but only kept as large as it is */
+    struct procFiles *shrunk = realloc(tree, count * sizeof(struct procFiles));
+    process->tree = shrunk != NULL ? shrunk : tree;
+    process->treeCount = count;
+}
+
+/* Method to sample a job from /proc. The CPU time of each process includes its children that were
+ * already waited for, so the time of short-lived commands in the tree is not lost */
+static void sampleJob(struct linkedProcess *process, struct jobSample *sample) {
+    char buffer[JOBS_BUFLEN];
+    long pageSize = sysconf(_SC_PAGESIZE);
+
+    memset(sample, 0, sizeof(struct jobSample));
+    sample->state = '?';
+    updateProcTree(process);
+
+    for (int i = 0; i < process->treeCount; i++) {
+        struct procFiles *files = &process->tree[i];
+
+        /* The fields after the command name, which may contain spaces, start with the state */
+        char *fields;
+        if (readProcFile(files->statFd, buffer, sizeof(buffer)) <= 0 || (fields = strrchr(buffer, ')')) == NULL) {
+            continue;
+        }
+        char state;
+        unsigned long long utime, stime, rss;
+        long long cutime, cstime;
+        if (sscanf(fields + 2, "%c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu %lld %lld %*d %*d %*d %*d %*u %*u %llu",
+                &state, &utime, &stime, &cutime, &cstime, &rss) != 6) {
+            continue;
+        }
+        if (files->pid == process->pid) {
+            sample->state = state;
+        }
+        sample->processes++;
+        sample->ticks += utime + stime + cutime + cstime;
+        sample->rss += rss * pageSize;
+
+        /* /proc/<pid>/io can only be read for our own processes */
+        if (readProcFile(files->ioFd, buffer, sizeof(buffer)) > 0) {
+            unsigned long long readBytes = 0, writeBytes = 0;
+            char *str = strstr(buffer, "rchar:");
+            if (str != NULL) {
+                readBytes = strtoull(str + 6, NULL, 10);
+            }
+            if ((str = strstr(buffer, "wchar:")) != NULL) {
+                writeBytes = strtoull(str + 6, NULL, 10);
+            }
+            sample->readBytes += readBytes;
+            sample->writeBytes += writeBytes;
+        }
+    }
+}
+
+/* Method to format a number of bytes with a K, M, G or T suffix */
+static void formatBytes(char *buffer, int size, unsigned long long bytes) {
+    const char *units = "BKMGT";
+    double value = bytes;
+    int unit = 0;
+
+    while (value >= 1024 && unit < 4) {
+        value /= 1024;
+        unit++;
+    }
+    if (unit == 0) {
+        snprintf(buffer, size, "%lluB", bytes);
+    }
+    else {
+        snprintf(buffer, size, "%.1f%c", value, units[unit]);
+    }
+}
+
+/* Prints the state, CPU, memory, I/O and elapsed time of every job. The CPU % is measured since the
+ * last sample of the job, or since it started */
+static void printJobTable(flush_ctx *ctx) {
+    long ticksPerSecond = sysconf(_SC_CLK_TCK);
+
+    dprintf(ctx->fds[1], "%-8s %-5s %6s %8s %8s %8s %10s %5s  %s\n",
+            "PID", "STATE", "CPU%", "RSS", "READ", "WRITE", "ELAPSED", "PROCS", "COMMAND");
+    for (struct linkedProcess *process = ctx->head; process != NULL; process = process->next) {
+        struct jobSample sample;
+        char rss[16], readBytes[16], writeBytes[16], elapsed[32];
+        long long now;
+
+        sampleJob(process, &sample);
+        now = getMilliseconds();
+
+        double cpu = 0;
+        if (now > process->lastSample && sample.ticks >= process->lastTicks) {
+            cpu = (sample.ticks - process->lastTicks) * 100000.0 / ticksPerSecond / (now - process->lastSample);
+        }
+        process->lastTicks = sample.ticks;
+        process->lastSample = now;
+
+        long long seconds = (now - process->started) / 1000;
+        snprintf(elapsed, sizeof(elapsed), "%lld:%02lld:%02lld", seconds / 3600, seconds / 60 % 60, seconds % 60);
+        formatBytes(rss, sizeof(rss), sample.rss);
+        formatBytes(readBytes, sizeof(readBytes), sample.readBytes);
+        formatBytes(writeBytes, sizeof(writeBytes), sample.writeBytes);
+
+        dprintf(ctx->fds[1], "%-8d %-5c %6.1f %8s %8s %8s %10s %5d  %s\n", process->pid, sample.state, cpu,
+                rss, readBytes, writeBytes, elapsed, sample.processes, process->name);
+    }
+}
+
+/* Method for the "jobs" builtin. "jobs -l" prints the telemetry of every job, and "jobs -w" refreshes
+ * it every second until enter is pressed or every job has finished */
+static int jobsCommand(flush_ctx *ctx, char **args) {
+    if (args[1] == NULL) {
+        printAllProcesses(ctx);
+        return 0;
+    }
+    if (strcmp(args[1], "-l") == 0) {
+        printJobTable(ctx);
+        return 0;
+    }
+    if (strcmp(args[1], "-w") != 0) {
+        dprintf(ctx->fds[1], "flush: usage: jobs [-l | -w]\n");
+        return 1;
+    }
+
+    long long nextFrame = 0;
+    while (ctx->head != NULL) {
+        struct pollfd pfds[2] = { { ctx->fds[0], POLLIN, 0 }, { ctx->timerFd, POLLIN, 0 } };
+        long long now = getMilliseconds();
+
+        if (now >= nextFrame) {
+            dprintf(ctx->fds[1], "\033[H\033[J");
+            printJobTable(ctx);
+            dprintf(ctx->fds[1], "press enter to stop\n");
+            nextFrame = now + 1000;
+        }
+        if (poll(pfds, 2, nextFrame - now) == -1 && errno != EINTR) {
+            printError(ctx, "flush: poll error\n");
+            return 1;
+        }
+
+        /* Reads the rest of the line, so that it is not taken as the next command */
+        if (pfds[0].revents) {
+            char c;
+            while (read(ctx->fds[0], &c, 1) == 1 && c != '\n');
+            break;
+        }
+        checkForCompleteProcesses(ctx);
+    }
+    return 0;
+}
+
+/* Method to parse a duration like timeout(1) does, a number with an optional s, m, h or d suffix.
+ * Returns milliseconds, or -1 if it is not a duration */
+static long long parseDuration(const char *str) {
+    char *end;
+    double value = strtod(str, &end);
+
+    if (end == str || value < 0) {
+        return -1;
+    }
+    switch (*end) {
+        case '\0':
+        case 's':
+            break;
+        case 'm':
+            value *= 60;
+            break;
+        case 'h':
+            value *= 60 * 60;
+            break;
+        case 'd':
+            value *= 24 * 60 * 60;
+            break;
+        default:
+            return -1;
+    }
+    if (*end != '\0' && end[1] != '\0') {
+        return -1;
+    }
+    return (long long) (value * 1000);
+}
+
+/* Method to execute the command from the user */
+static int execute(flush_ctx *ctx, char **args, char *input) {
+    int background = checkIfBackgroundTask(input);
+    long long timeout = 0, killAfter = 0;
+
+    /* "timeout DURATION [--kill-after D] command" gives the command a deadline */
+    if (strcmp(args[0], "timeout") == 0) {
+        int index = 1;
+        while (args[index] != NULL) {
+            if ((strcmp(args[index], "--kill-after") == 0 || strcmp(args[index], "-k") == 0) && args[index + 1]) {
+                if ((killAfter = parseDuration(args[++index])) == -1) {
+                    break;
+                }
+            }
+            else if (strncmp(args[index], "--kill-after=", 13) == 0) {
+                if ((killAfter = parseDuration(args[index] + 13)) == -1) {
+                    break;
+                }
+            }
+            else if (timeout == 0) {
+                if ((timeout = parseDuration(args[index])) <= 0) {
+                    break;
+                }
+            }
+            else {
+                break;
+            }
+            index++;
+        }
+        if (args[index] == NULL || timeout <= 0 || killAfter == -1) {
+            dprintf(ctx->fds[1], "flush: usage: timeout DURATION [--kill-after D] command\n");
+            return 125;
+        }
+        args += index;
+
+        /* Builtins run in the shell itself, and the cache and on-change would leave their commands
+         * running when signalled, so none of them takes a deadline */
+        if (isBuiltin(args[0]) || strcmp(args[0], "timeout") == 0) {
+            dprintf(ctx->fds[1], "flush: timeout: %s is a builtin\n", args[0]);
+            return 125;
+        }
+    }
+
+    /* Internal commands */
+    if (strcmp(args[0], "help") == 0) {
+        dprintf(ctx->fds[1], "flush: enter a Linux command, or 'exit' to quit\n");
+        return 0;
+    } 
+
+    if (strcmp(args[0], "cd") == 0) {
+        if (args[1] != NULL) {
+            int cd = changeDirectory(ctx, args[1]);
+            if (cd != 0) {
+                printError(ctx, "flush: cd error\n");
+                return 1;
+            }  
+        }
+        else {
+            dprintf(ctx->fds[1], "flush: no argument was given for cd\n");
+            return 1;
+        }
+        return 0;
+    }
+
+    if (strcmp(args[0], "jobs") == 0) {
+        return jobsCommand(ctx, args);
+    }
+
+    /* "export NAME=VALUE" and "unset NAME" change the environment given to commands */
+    if (strcmp(args[0], "export") == 0 || strcmp(args[0], "unset") == 0) {
+        int export = strcmp(args[0], "export") == 0;
+        for (int i = 1; args[i] != NULL; i++) {
+            char *value = strchr(args[i], '=');
+            if (value != NULL) {
+                *value++ = '\0';
+            }
+            if (export && value == NULL) {
+                continue;
+            }
+            if (setVariable(ctx, args[i], export ? value : NULL) == -1) {
+                printError(ctx, "flush: env error\n");
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    /* The cache and on-change wait for the commands they run, so with '&' they run in a subshell */
+    if ((strcmp(args[0], "cache") == 0 || strcmp(args[0], "on-change") == 0) && background) {
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid < 0) {
+            printError(ctx, "flush: fork error\n");
+            return 1;
+        }
+        if (pid == 0) {
+            int status;
+            enterSubshell(ctx);
+            if (args[0][0] == 'c') {
+                /* The shell reports the status of the cache when it reaps the job */
+                ctx->flags |= FLUSH_QUIET;
+                ctx->callback = NULL;
+                status = cacheCommand(ctx, args + 1, input);
+            }
+            else {
+                status = onChangeCommand(ctx, args + 1);
+            }
+            fflush(stdout);
+            _exit(status);
+        }
+        addProcess(ctx, pid, input);
+        return 0;
+    }
+
+    if (strcmp(args[0], "cache") == 0) {
+        return cacheCommand(ctx, args + 1, input);
+    }
+
+    if (strcmp(args[0], "on-change") == 0) {
+        return onChangeCommand(ctx, args + 1);
+    }
+
+    if (strcmp(args[0], "set") == 0) {
+        if (args[1] != NULL && args[2] != NULL && strcmp(args[2], "dagparallel") == 0
+                && (strcmp(args[1], "-o") == 0 || strcmp(args[1], "+o") == 0)) {
+            ctx->dagParallel = args[1][0] == '-';
+        }
+        else if (args[1] == NULL || strcmp(args[1], "-o") == 0) {
+            dprintf(ctx->fds[1], "dagparallel\t%s\n", ctx->dagParallel ? "on" : "off");
+        }
+        else {
+            dprintf(ctx->fds[1], "flush: usage: set -o|+o dagparallel\n");
+            return 1;
+        }
+        return 0;
+    }
+
+    int status;
+    int fds[3] = { ctx->jobFds[0], ctx->jobFds[1], ctx->jobFds[2] };
+    struct substitutions subs = { 0 };
+
+    /* The substitutions are started first, so that "> >(command)" redirects into the pipe */
+    if (startSubstitutions(ctx, args, &subs) == -1 || openRedirections(ctx, args, fds) == -1) {
+        closeRedirections(ctx, fds);
+        closeSubstitutions(&subs);
+        finishSubstitutions(ctx, &subs, 0);
+        return 1;
+    }
+    pid_t pid = spawnCommand(ctx, args, fds, subs.fds);
+    closeRedirections(ctx, fds);
+    closeSubstitutions(&subs);
+
+    if (pid < 0) {
+        printError(ctx, "flush: fork error\n");
+        finishSubstitutions(ctx, &subs, 0);
+        return 1;
+    }
+
+    /* Inside arent process. If the command is flagged as a background task, it is added to the linked list. */                           
+    /* A foreground command with a timeout is in the list while it runs, so that its deadline is enforced */
+    struct linkedProcess *process = NULL;
+    if (background || timeout != 0) {
+        addProcess(ctx, pid, input);
+        process = ctx->tail;
+        if (timeout != 0) {
+            process->deadline = getMilliseconds() + timeout;
+            process->killAfter = killAfter;
+            armTimer(ctx);
+        }
+    }
+    if (background) {
+        finishSubstitutions(ctx, &subs, 1);
+        return 0;
+    }
+
+    waitForeground(ctx, pid, &status);
+    if (process != NULL) {
+        status = getTimeoutStatus(process, status);
+        removeProcess(ctx, process);
+        armTimer(ctx);
+    }
+    finishSubstitutions(ctx, &subs, 0);
+    checkStatus(ctx, pid, status, input);
+    return exitCode(status);
+}
+
+/* Method to check whether a command is handled by the shell itself */
+static int isBuiltin(char *name) {
+    char *builtins[] = { "help", "cd", "jobs", "export", "unset", "cache", "on-change", "set", NULL };
+    for (int i = 0; builtins[i] != NULL; i++) {
+        if (strcmp(name, builtins[i]) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Method to check whether an arg is one of the list operators */
+static int isOperator(char *arg) {
+    return strcmp(arg, ";") == 0 || strcmp(arg, "&&") == 0 || strcmp(arg, "||") == 0 || strcmp(arg, "&") == 0;
+}
+
+/* Method to free a parsed command list */
+static void freeCommandList(struct commandNode *node) {
+    while (node != NULL) {
+        struct commandNode *next = node->next;
+        freeCommandList(node->body);
+        free(node->args);
+        free(node->inputs);
+        free(node->outputs);
+        free(node);
+        node = next;
+    }
+}
+
+/* Method to parse one command, either a simple command or a { ... } group. Returns NULL on a syntax error */
+static struct commandNode *parseCommand(flush_ctx *ctx, char **args, int *index, int depth) {
+    struct commandNode *node = calloc(1, sizeof(struct commandNode));
+    node->op = OP_SEQ;
+
+    if (strcmp(args[*index], "{") == 0) {
+        (*index)++;
+        node->type = NODE_GROUP;
+        node->body = parseList(ctx, args, index, depth + 1);
+        if (node->body == NULL || args[*index] == NULL || strcmp(args[*index], "}") != 0) {
+            if (node->body != NULL) {
+                dprintf(ctx->fds[1], "flush: syntax error, missing '}'\n");
+            }
+            freeCommandList(node);
+            return NULL;
+        }
+        (*index)++;
+        strcpy(node->name, "{ ... }");
+        return node;
+    }
+
+    /* Collects the args up to the next operator. '@in' and '@out' declare files for dagparallel */
+    int length = 0;
+    while (args[*index + length] != NULL && !isOperator(args[*index + length])
+            && !(depth > 0 && strcmp(args[*index + length], "}") == 0)) {
+        length++;
+    }
+    node->type = NODE_SIMPLE;
+    node->args = calloc(length + 1, sizeof(char *));
+    node->inputs = calloc(length + 1, sizeof(char *));
+    node->outputs = calloc(length + 1, sizeof(char *));
+
+    int argCount = 0, inputCount = 0, outputCount = 0;
+    for (int i = *index; i < *index + length; i++) {
+        if ((strcmp(args[i], "@in") == 0 || strcmp(args[i], "@out") == 0) && i + 1 < *index + length) {
+            if (args[i][1] == 'i') {
+                node->inputs[inputCount++] = args[++i];
+            }
+            else {
+                node->outputs[outputCount++] = args[++i];
+            }
+            continue;
+        }
+
+        /* Redirections also count as declared files */
+        if (strcmp(args[i], "<") == 0 && i + 1 < *index + length) {
+            node->inputs[inputCount++] = args[i + 1];
+        }
+        else if (strcmp(args[i], ">") == 0 && i + 1 < *index + length) {
+            node->outputs[outputCount++] = args[i + 1];
+        }
+        node->args[argCount++] = args[i];
+
+        if (strlen(node->name) + strlen(args[i]) + 4 < MAXLEN) {
+            if (argCount > 1) {
+                strcat(node->name, " ");
+            }
+            strcat(node->name, args[i]);
+        }
+    }
+    *index += length;
+
+    if (argCount == 0) {
+        dprintf(ctx->fds[1], "flush: syntax error near '%s'\n", args[*index] ? args[*index] : "newline");
+        freeCommandList(node);
+        return NULL;
+    }
+    return node;
+}
+
+/* Method to parse a list of commands joined by ';', '&&', '||' and '&'. Returns NULL on a syntax error */
+static struct commandNode *parseList(flush_ctx *ctx, char **args, int *index, int depth) {
+    struct commandNode *first = NULL, *last = NULL;
+
+    while (args[*index] != NULL && !(depth > 0 && strcmp(args[*index], "}") == 0)) {
+        struct commandNode *node = parseCommand(ctx, args, index, depth);
+        if (node == NULL) {
+            freeCommandList(first);
+            return NULL;
+        }
+
+        if (last != NULL) {
+            last->next = node;
+        }
+        else {
+            first = node;
+        }
+        last = node;
+
+        /* Reads the operator that joins the command to the next one */
+        if (args[*index] != NULL && isOperator(args[*index])) {
+            char *op = args[(*index)++];
+            node->op = strcmp(op, "&&") == 0 ? OP_AND : strcmp(op, "||") == 0 ? OP_OR
+                : strcmp(op, "&") == 0 ? OP_BG : OP_SEQ;
+            if ((node->op == OP_AND || node->op == OP_OR)
+                    && (args[*index] == NULL || strcmp(args[*index], "}") == 0)) {
+                dprintf(ctx->fds[1], "flush: syntax error near '%s'\n", op);
+                freeCommandList(first);
+                return NULL;
+            }
+        }
+    }
+
+    if (first == NULL) {
+        dprintf(ctx->fds[1], "flush: syntax error near '%s'\n", args[*index] ? args[*index] : "newline");
+    }
+    return first;
+}
+
+/* Method to check whether two lists of declared files have a file in common */
+static int sharesFile(char **files, char **others) {
+    for (int i = 0; files[i] != NULL; i++) {
+        for (int j = 0; others[j] != NULL; j++) {
+            if (strcmp(files[i], others[j]) == 0) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/* Method to check whether a later command has to wait for an earlier one. This is the case when one
+ * writes a file that the other reads or writes */
+static int dependsOn(struct commandNode *later, struct commandNode *earlier) {
+    return sharesFile(later->inputs, earlier->outputs)
+        || sharesFile(later->outputs, earlier->outputs)
+        || sharesFile(later->outputs, earlier->inputs);
+}
+
+/* Method to check whether a command can be scheduled by dagparallel. Commands with a timeout are not,
+ * since their deadline is kept in the job list, and neither are commands with process substitutions */
+static int isGraphCommand(struct commandNode *node) {
+    if (node->type != NODE_SIMPLE || node->op != OP_SEQ || isBuiltin(node->args[0])
+            || strcmp(node->args[0], "timeout") == 0) {
+        return 0;
+    }
+    for (int i = 0; node->args[i] != NULL; i++) {
+        if (isSubstitution(node->args[i])) {
+            return 0;
+        }
+    }
+    return node->inputs[0] != NULL || node->outputs[0] != NULL;
+}
+
+/* Method to run commands with declared files concurrently, like a small build graph. A command starts
+ * once every earlier command it depends on has finished, with at most one command per core */
+static int runGraph(flush_ctx *ctx, struct commandNode **nodes, int count) {
+    int state[count], pids[count], running[count];
+    int runningCount = 0, done = 0, lastStatus = 0;
+    long maxJobs = sysconf(_SC_NPROCESSORS_ONLN);
+    if (maxJobs < 1) {
+        maxJobs = 1;
+    }
+    memset(state, 0, sizeof(state));
+
+    while (done < count) {
+        /* Starts every command that is ready. State 0 is waiting, 1 is running and 2 is done */
+        for (int i = 0; i < count && runningCount < maxJobs; i++) {
+            int ready = state[i] == 0;
+            for (int j = 0; j < i && ready; j++) {
+                ready = state[j] == 2 || !dependsOn(nodes[i], nodes[j]);
+            }
+            if (!ready) {
+                continue;
+            }
+
+            char *args[MAXLEN];
+            int fds[3] = { ctx->jobFds[0], ctx->jobFds[1], ctx->jobFds[2] }, argCount = 0;
+            while (nodes[i]->args[argCount] != NULL) {
+                args[argCount] = nodes[i]->args[argCount];
+                argCount++;
+            }
+            args[argCount] = NULL;
+
+            pids[i] = -1;
+            if (openRedirections(ctx, args, fds) == 0) {
+                pids[i] = spawnCommand(ctx, args, fds, NULL);
+                if (pids[i] < 0) {
+                    printError(ctx, "flush: fork error\n");
+                }
+            }
+            closeRedirections(ctx, fds);
+
+            if (pids[i] < 0) {
+                state[i] = 2;
+                done++;
+                if (i == count - 1) {
+                    lastStatus = 1;
+                }
+                continue;
+            }
+            state[i] = 1;
+            running[runningCount++] = pids[i];
+        }
+
+        if (runningCount == 0) {
+            continue;
+        }
+
+        /* Waits for any running command and marks it as done */
+        int status;
+        int pid = reapAny(ctx, running, runningCount, &status);
+        if (pid < 0) {
+            printError(ctx, "flush: wait error\n");
+            return 1;
+        }
+        for (int i = 0; i < runningCount; i++) {
+            if (running[i] == pid) {
+                running[i] = running[--runningCount];
+                break;
+            }
+        }
+        for (int i = 0; i < count; i++) {
+            if (state[i] == 1 && pids[i] == pid) {
+                state[i] = 2;
+                done++;
+                checkStatus(ctx, pid, status, nodes[i]->name);
+                if (i == count - 1) {
+                    lastStatus = exitCode(status);
+                }
+            }
+        }
+    }
+    return lastStatus;
+}
+
+/* Method to run one command of a list, in the background if the command ends with '&' */
+static int runCommand(flush_ctx *ctx, struct commandNode *node) {
+    int background = node->op == OP_BG;
+
+    if (node->type == NODE_GROUP) {
+        if (!background) {
+            return runList(ctx, node->body);
+        }
+
+        /* A background group runs in a subshell that forks its commands directly */
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid < 0) {
+            printError(ctx, "flush: fork error\n");
+            return 1;
+        }
+        if (pid == 0) {
+            enterSubshell(ctx);
+            int status = runList(ctx, node->body);
+            fflush(stdout);
+            _exit(status);
+        }
+        addProcess(ctx, pid, node->name);
+        return 0;
+    }
+
+    /* execute(ctx) changes args and input, so it gets copies */
+    char *args[MAXLEN];
+    char input[MAXLEN + 2];
+    int argCount = 0;
+    while (node->args[argCount] != NULL) {
+        args[argCount] = node->args[argCount];
+        argCount++;
+    }
+    args[argCount] = NULL;
+    snprintf(input, sizeof(input), "%s%s", node->name, background ? " &" : "");
+    return execute(ctx, args, input);
+}
+
+/* Method to run a parsed command list. '&&' and '||' skip the next command depending on the last status */
+static int runList(flush_ctx *ctx, struct commandNode *node) {
+    int status = 0, op = OP_SEQ;
+
+    while (node != NULL) {
+        /* Collects commands with declared files that follow each other, and runs them as a graph */
+        if (ctx->dagParallel && op == OP_SEQ && isGraphCommand(node)) {
+            struct commandNode *nodes[MAXLEN];
+            int count = 0;
+            while (node != NULL && count < MAXLEN && isGraphCommand(node)) {
+                nodes[count++] = node;
+                node = node->next;
+            }
+            status = runGraph(ctx, nodes, count);
+            op = OP_SEQ;
+            continue;
+        }
+
+        if (!(op == OP_AND && status != 0) && !(op == OP_OR && status == 0)) {
+            status = runCommand(ctx, node);
+        }
+        op = node->op;
+        node = node->next;
+    }
+    return status;
+}
+
+/* Method to count the background tasks in the linked list */
+static int countProcesses(flush_ctx *ctx) {
+    int count = 0;
+    for (struct linkedProcess *process = ctx->head; process != NULL; process = process->next) {
+        count++;
+    }
+    return count;
+}
+
+flush_ctx *flush_ctx_new(int flags) {
+    flush_ctx *ctx = calloc(1, sizeof(flush_ctx));
+    if (ctx == NULL) {
+        return NULL;
+    }
+    ctx->flags = flags;
+    getrlimit(RLIMIT_NOFILE, &ctx->fileLimit);
+    ctx->fds[1] = ctx->jobFds[1] = 1;
+    ctx->fds[2] = ctx->jobFds[2] = 2;
+    ctx->zygoteSocket = -1;
+    ctx->cwd = -1;
+    ctx->timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (ctx->timerFd == -1) {
+        free(ctx);
+        return NULL;
+    }
+
+    /* A session starts from a copy of the directory and the environment of the process */
+    if (flags & FLUSH_SESSION) {
+        int count = 0;
+        while (environ[count] != NULL) {
+            count++;
+        }
+        ctx->env = calloc(count + 1, sizeof(char *));
+        ctx->cwd = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (ctx->env == NULL || ctx->cwd == -1) {
+            flush_ctx_free(ctx);
+            return NULL;
+        }
+        for (int i = 0; i < count; i++) {
+            ctx->env[i] = strdup(environ[i]);
+        }
+    }
+
+    if (flags & FLUSH_ZYGOTE) {
+        startZygote(ctx);
+    }
+    return ctx;
+}
+
+void flush_ctx_free(flush_ctx *ctx) {
+    while (ctx->head != NULL) {
+        removeProcess(ctx, ctx->head);
+    }
+    while (ctx->reaped != NULL) {
+        struct reapedProcess *next = ctx->reaped->next;
+        free(ctx->reaped);
+        ctx->reaped = next;
+    }
+
+    if (ctx->env != NULL) {
+        for (char **str = ctx->env; *str != NULL; str++) {
+            free(*str);
+        }
+        free(ctx->env);
+    }
+    if (ctx->cwd != -1) {
+        close(ctx->cwd);
+    }
+    close(ctx->timerFd);
+
+    /* Closing the socket makes the zygote exit */
+    if (ctx->zygoteSocket != -1) {
+        close(ctx->zygoteSocket);
+    }
+    free(ctx->zygoteBuffer);
+    free(ctx);
+}
+
+void flush_set_stdio(flush_ctx *ctx, int in, int out, int err) {
+    ctx->fds[0] = ctx->jobFds[0] = in;
+    ctx->fds[1] = ctx->jobFds[1] = out;
+    ctx->fds[2] = ctx->jobFds[2] = err;
+}
+
+void flush_set_output(flush_ctx *ctx, int out, int err) {
+    ctx->fds[1] = out;
+    ctx->fds[2] = err;
+}
+
+void flush_set_callback(flush_ctx *ctx, flush_callback callback, void *data) {
+    ctx->callback = callback;
+    ctx->callbackData = data;
+}
+
+int flush_exec(flush_ctx *ctx, const char *line) {
+    char *args[MAXLEN];
+    char *buffer = malloc(2 * strlen(line) + 2);
+    int status = 0;
+
+    if (buffer == NULL) {
+        printError(ctx, "flush: exec error\n");
+        return 1;
+    }
+
+    /* Parses the line into arguments, and runs them as a command list */
+    parseString(line, buffer, args);
+    if (args[0] != NULL) {
+        int index = 0;
+        struct commandNode *list = parseList(ctx, args, &index, 0);
+        status = list != NULL ? runList(ctx, list) : 2;
+        freeCommandList(list);
+    }
+    free(buffer);
+    return status;
+}
+
+int flush_spawn(flush_ctx *ctx, const char *line) {
+    char *args[MAXLEN];
+    char *buffer = malloc(2 * strlen(line) + 2);
+    struct linkedProcess *last = ctx->tail;
+
+    if (buffer == NULL) {
+        printError(ctx, "flush: exec error\n");
+        return -1;
+    }
+    parseString(line, buffer, args);
+    if (args[0] == NULL) {
+        free(buffer);
+        return 0;
+    }
+
+    int index = 0;
+    struct commandNode *list = parseList(ctx, args, &index, 0);
+    if (list == NULL) {
+        free(buffer);
+        return -1;
+    }
+
+    if (list->next == NULL && list->type == NODE_SIMPLE && isBuiltin(list->args[0])
+            && strcmp(list->args[0], "cache") != 0 && strcmp(list->args[0], "on-change") != 0) {
+        /* A builtin changes the shell itself, so it runs right away. The cache and on-change run
+         * commands, so they are left to the background group below */
+        int status = runList(ctx, list);
+        checkStatus(ctx, 0, W_EXITCODE(status, 0), list->name);
+    }
+    else if (list->next == NULL && list->type == NODE_SIMPLE) {
+        list->op = OP_BG;
+        runCommand(ctx, list);
+    }
+    else {
+        /* Anything else runs as a background group, named after the whole line */
+        struct commandNode *group = calloc(1, sizeof(struct commandNode));
+        group->type = NODE_GROUP;
+        group->op = OP_BG;
+        group->body = list;
+        snprintf(group->name, MAXLEN, "%s", line);
+        group->name[strcspn(group->name, "\n")] = 0;
+        list = group;
+        runCommand(ctx, list);
+    }
+    freeCommandList(list);
+    free(buffer);
+
+    return ctx->tail != last && ctx->tail != NULL ? ctx->tail->pid : 0;
+}
+
+int flush_event_fd(flush_ctx *ctx) {
+    return ctx->timerFd;
+}
+
+void flush_kill(flush_ctx *ctx, int sig) {
+    for (struct linkedProcess *process = ctx->head; process != NULL; process = process->next) {
+        kill(process->pid, sig);
+    }
+}
+
+int flush_wait(flush_ctx *ctx, int pid, int options) {
+    if (options & FLUSH_NOHANG) {
+        checkForCompleteProcesses(ctx);
+        return countProcesses(ctx);
+    }
+
+    /* Waits for the matching tasks one at a time, in the order they finish */
+    int count;
+    while ((count = countProcesses(ctx)) > 0) {
+        int pids[count], found = 0, status;
+        for (struct linkedProcess *process = ctx->head; process != NULL; process = process->next) {
+            if (pid == -1 || process->pid == pid) {
+                pids[found++] = process->pid;
+            }
+        }
+        if (found == 0) {
+            break;
+        }
+
+        int done = reapAny(ctx, pids, found, &status);
+        if (done < 0) {
+            printError(ctx, "flush: wait error\n");
+            break;
+        }
+        for (struct linkedProcess *process = ctx->head; process != NULL; process = process->next) {
+            if (process->pid == done) {
+                if (!process->quiet) {
+                    checkStatus(ctx, done, getTimeoutStatus(process, status), process->name);
+                }
+                removeProcess(ctx, process);
+                break;
+            }
+        }
+    }
+    return countProcesses(ctx);
+}
@@ -0,0 +1,65 @@
+#ifndef FLUSH_H
+#define FLUSH_H
+
+/* libflush: the tokenizer, executor and job table of flush, for running flush command lines in-process.
+ * Every piece of state lives in a flush_ctx, so a program can keep several independent shells. Build it
+ * together with the front-end, e.g. "cc -o flush main3.c flush.c serve.c" */
+
+/* Flags for flush_ctx_new */
+#define FLUSH_ZYGOTE 1
+#define FLUSH_QUIET 2
+#define FLUSH_SESSION 4
+
+/* Options for flush_wait */
+#define FLUSH_NOHANG 1
+
+typedef struct flush_ctx flush_ctx;
+
+/* Called when a command or background job has finished. status is the status from waitpid, and pid is 0
+ * for commands that were answered without a process, like a hit in the result cache */
+typedef void (*flush_callback)(flush_ctx *ctx, int pid, const char *name, int status, void *data);
+
+/* Creates a context. With FLUSH_ZYGOTE the zygote is forked right away, so call this early while the
+ * program is still small. With FLUSH_QUIET the "exit status" lines are not printed. With FLUSH_SESSION
+ * the context gets its own copy of the current directory and environment, which "cd", "export" and
+ * "unset" change without touching the process */
+flush_ctx *flush_ctx_new(int flags);
+
+/* Frees a context. Background jobs that are still running are left alone */
+void flush_ctx_free(flush_ctx *ctx);
+
+/* Sets the stdin, stdout and stderr used by commands and by the messages of the shell */
+void flush_set_stdio(flush_ctx *ctx, int in, int out, int err);
+
+/* Sets where only the messages of the shell go, like the "exit status" lines, errors and the output of
+ * builtins, while commands keep the stdio from flush_set_stdio. Call it after flush_set_stdio */
+void flush_set_output(flush_ctx *ctx, int out, int err);
+
+/* Sets the function called for every finished command */
+void flush_set_callback(flush_ctx *ctx, flush_callback callback, void *data);
+
+/* Runs a command line and returns the exit code of the last command, or 2 on a syntax error.
+ * Commands ending with '&' are added to the job table */
+int flush_exec(flush_ctx *ctx, const char *line);
+
+/* Starts a command line without waiting for it and returns the pid of its job. A single builtin runs
+ * right away and 0 is returned, and -1 is returned on a syntax error */
+int flush_spawn(flush_ctx *ctx, const char *line);
+
+/* Returns a file descriptor that becomes readable when a job with a timeout is due. Call flush_wait with
+ * FLUSH_NOHANG when it does, so the job is signalled while the program waits for something else */
+int flush_event_fd(flush_ctx *ctx);
+
+/* Sends a signal to every background job */
+void flush_kill(flush_ctx *ctx, int sig);
+
+/* Waits for the background job pid, or for every job if pid is -1. With FLUSH_NOHANG it only collects
+ * the jobs that are already done. Returns the number of jobs that are still running */
+int flush_wait(flush_ctx *ctx, int pid, int options);
+
+/* Runs flush as a daemon on a Unix domain socket. Every client gets a session, and its command lines
+ * are run as jobs whose output and exit status are sent back. A client may have clientJobs jobs at a
+ * time and all clients together maxJobs, further lines wait. Returns when SIGINT or SIGTERM arrives */
+int flush_serve(const char *path, int maxJobs, int clientJobs);
+
+#endif
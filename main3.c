@@ -1,28 +1,14 @@
-#include <time.h>
 #include <stdio.h>
 #include <string.h>
-#include <stddef.h>
 #include <stdlib.h>
 #include <unistd.h>
-#include <signal.h>
-#include <sys/wait.h>
-#include <sys/types.h>
-#include <fcntl.h>
-#include <errno.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include "flush.h"
 
 #define MAXLEN 200
-
-/* Struvt for the linked list process */
-struct linkedProcess {
-    int pid;
-    char name[MAXLEN];
-    struct linkedProcess *previous;
-    struct linkedProcess *next;
-};
-
-/* Global variables for linked list of background tasks */
-struct linkedProcess *head = NULL;
-struct linkedProcess *tail = NULL;
+#define SERVE_MAXJOBS 64
+#define SERVE_CLIENTJOBS 8
 
 /* Initializing the flush to the user */
 void init_shell() {
@@ -36,226 +22,71 @@ void init_shell() {
     printf("\033[H\033[J");
 }
 
-/* Method to check the status og an exited task */
-void checkStatus(int status, char *input) {
-    input[strcspn(input, "\n")] = 0;
-
-    if (WIFEXITED(status)) {
-        int exitStatus = WEXITSTATUS(status);
-        printf("exit status [%s] = %d\n", input, exitStatus);
-    }
-}
-
-/* Method to add a node to the linked list*/
-void addProcess(int pid, char *name) {
-    struct linkedProcess *newProcess = (struct linkedProcess*) malloc(sizeof(struct linkedProcess));
-
-    /* Updates the values */
-    newProcess->pid = pid;
-    strcpy(newProcess->name, name);
-
-    /* Updates the previous pointer */
-    newProcess->previous = tail;
-    if (tail != NULL) {
-        tail->next = newProcess;
-    }
-    tail = newProcess;
-
-    /* Updates the next pointer */
-    newProcess->next = NULL;
-    if (head == NULL) {
-        head = newProcess;
-    }
-}
-
-/* Prints all nodes in the linked list. The method is called as the promt "jobs" */
-void printAllProcesses() {
-    struct linkedProcess *process = head;
-    while (process != NULL) {
-        printf("[pid %d] %s\n", process->pid, process->name);
-        process = process->next;
-    } 
-}
-
-/* Method to remove a given process from the linked list */
-void removeProcess(struct linkedProcess *process) {
-    /* Checks if the linked process is the first process */
-    if (process->previous != NULL) {
-        process->previous->next = process->next;
-    }
-    else {
-        head = process->next;
-    }
+/* Method to wait until the user has typed something. Timeouts of jobs are enforced while waiting */
+void waitForInput(flush_ctx *ctx) {
+    struct pollfd pfds[2] = { { STDIN_FILENO, POLLIN, 0 }, { flush_event_fd(ctx), POLLIN, 0 } };
 
-    /* Checks if the linked process is the last node */
-    if (process->next != NULL) {
-        process->next->previous = process->previous;
-    }
-    else {
-        tail = process->previous;
-    }
-
-    free(process);
-}
-
-/* Method to check for complete processes. If a process is teminated it gets removed */
-void checkForCompleteProcesses() {
-    struct linkedProcess *process = head;
-    while (process != NULL) {
-        int status;
-
-        /* Checks if processes are complete */
-        if (waitpid(process->pid, &status, WNOHANG)) {
-            checkStatus(status, process->name);
-            removeProcess(process);
+    while (poll(pfds, 2, -1) != -1 && !(pfds[0].revents & (POLLIN | POLLHUP | POLLERR))) {
+        if (pfds[1].revents & POLLIN) {
+            flush_wait(ctx, -1, FLUSH_NOHANG);
         }
-        process = process->next;
-    }
-}
-
-/* Method to parse a string into args */
-void parseString(char *str, char **args) {
-    char delim[4] = "\t \n";
-
-    for (int i = 0; i < MAXLEN; i++) {
-        args[i] = strsep(&str, delim);
-        if (args[i] == NULL)
-            break;
-        if (strlen(args[i]) == 0)
-            i--;
     }
 }
 
-/* Method to check whether a task is to be executed as a background task */
-int checkIfBackgroundTask(char input[MAXLEN]) {
-    /* Removes newline from input string */
-    input[strcspn(input, "\n")] = 0;
-    int length = strlen(input) - 1;
-
-    /* Checks for '&' and removes it from string */
-    int check = input[length] == '&';
-    if ((length > 0) && (input[length] == '&')) {
-        input[length] = '\0';
-        length--;
-    }
-    /* Removes trailing whitespaces after removing '&' */
-    while (length > -1) {
-        if (input[length] == ' ' || input[length] == '\t') {
-            length--;
+/* Method that runs the shell in a loop. It requests an input from the user and runs it with libflush. */
+int main(int argc, char **argv) {
+    char cwd[MAXLEN];
+    char input[MAXLEN];
+    char command[MAXLEN];
+    char *servePath = NULL;
+    int flags = 0, maxJobs = SERVE_MAXJOBS, clientJobs = SERVE_CLIENTJOBS;
+
+    /* The zygote has to be started first, while the shell is still small */
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-z") == 0) {
+            flags |= FLUSH_ZYGOTE;
         }
-        else {
-            break;
+        else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+            servePath = argv[++i];
         }
-        input[length + 1] = '\0';
-    }
-    return check;
-} 
-
-/* Method to execute the command from the user */
-void execute(char **args, char *input) {
-    int background = checkIfBackgroundTask(input);
-
-    /* Internal commands */
-    if (strcmp(args[0], "help") == 0) {
-        printf("flush: enter a Linux command, or 'exit' to quit\n");
-        return;
-    } 
-
-    if (strcmp(args[0], "cd") == 0) {
-        if (args[1] != NULL) {
-            int cd = chdir(args[1]);
-            if (cd != 0) {
-                perror("flush: cd error\n");
-            }  
+        else if (strcmp(argv[i], "--max-jobs") == 0 && i + 1 < argc) {
+            maxJobs = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--client-jobs") == 0 && i + 1 < argc) {
+            clientJobs = atoi(argv[++i]);
         }
         else {
-            printf("flush: no argument was given for cd\n");
+            printf("flush: usage: flush [-z] [--serve socket [--max-jobs n] [--client-jobs n]]\n");
+            exit(1);
         }
-        return;
-    }
-
-    if (strcmp(args[0], "jobs") == 0) {
-        printAllProcesses();
-        return;
     }
 
-    int status;
-    pid_t pid = fork();
-
-    if (pid < -1) {
-        perror("flush: fork error\n");
-        return;
+    /* Daemon mode. Command lines come from the clients of the socket instead of the user */
+    if (servePath != NULL) {
+        return flush_serve(servePath, maxJobs, clientJobs);
     }
-
-    if (pid == 0) {
-        int index = 0, fd;
-
-         /* I/O redirection. Parse args for '<' or '>' and filename */
-        while (args[index]) {  
-            if (*args[index] == '>' && args[index+1]) {
-                if ((fd = open(args[index+1], 
-                            O_WRONLY | O_CREAT, 
-                            S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH)) == -1) {
-                    perror(args[index+1]);
-                    exit(1);
-                }
-                dup2(fd, 1);
-                dup2(fd, 2);
-                close(fd);
-                /* Adjust the rest of the arguments in the array */
-                while (args[index]) {
-                    args[index] = args[index+2];
-                    index++; 
-                }
-                break;
-            }
-            else if (*args[index] == '<' && args[index+1]) {
-                if ((fd = open(args[index+1], O_RDONLY)) == -1) {
-                    perror(args[index+1]);
-                    exit(1);
-                }
-                dup2(fd, 0);
-                close(fd);
-                /* Adjust the rest of the arguments in the array */
-                while (args[index]) {
-                    args[index] = args[index+2];
-                    index++; 
-                }
-                break;
-            }
-            index++;
-        }
-
-        /* Exectute the command */
-        if (execvp(args[0], args) == -1) {
-            perror("flush: execvp error\n");
-        }
+    flush_ctx *ctx = flush_ctx_new(flags);
+    if (ctx == NULL) {
+        perror("flush: init error\n");
         exit(1);
     }
-    /* Inside arent process. If the command is flagged as a background task, it is added to the linked list. */                           
-    else {
-        if (background) {
-            addProcess(pid, input);
-        }
-        else {
-            waitpid(pid, &status, 0);
-            checkStatus(status, input);
-        }
-    }
-}
 
-/* Method that runs the shell in a loop. It requests an input from the user and calls the execute method. */
-int main(void) {
-    char cwd[MAXLEN];
-    char input[MAXLEN];
-    char inputString[MAXLEN];
-    char *args[MAXLEN];
+    /* "jobs -l" keeps three /proc files open for every job, so the file limit is raised as far as allowed.
+     * This happens after the context is created, so that commands still get the limit from before */
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
 
     init_shell();
 
+    /* stdin is not buffered, so that poll() on it sees every line that has not been read yet */
+    setvbuf(stdin, NULL, _IONBF, 0);
+
     while (1) {        
         /* Checks for complete background processes */
-        checkForCompleteProcesses();
+        flush_wait(ctx, -1, FLUSH_NOHANG);
 
         /* Gets the current working directory and asks for an input from the user */
         if (getcwd(cwd, sizeof(cwd)) != NULL) {
@@ -264,7 +95,9 @@ int main(void) {
         else {
             perror("flush: cwd error\n");
         }
+        fflush(stdout);
 
+        waitForInput(ctx);
         if (!fgets(input, sizeof(input), stdin)) {
             if (feof(stdin)) {
                 printf("flush: EOF signal is received\n");
@@ -275,22 +108,14 @@ int main(void) {
             }
         }
 
-        strcpy(inputString, input); 
-
-        /* Parses the input into arguments to be executed */
-        parseString(input, args);
-        for (int i = 0; i < MAXLEN; i++) {
-            if (!args[i]) {
-                break;
-            }
-        }
-
-        if (strcmp(args[0], "quit") == 0 || strcmp(args[0], "exit") == 0) {
+        if (sscanf(input, "%199s", command) == 1
+                && (strcmp(command, "quit") == 0 || strcmp(command, "exit") == 0)) {
             break;
         }
         
-        /* Execute the command */
-        execute(args, inputString);
+        /* Execute the command list */
+        flush_exec(ctx, input);
     }
+    flush_ctx_free(ctx);
     return 0;
 }
\ No newline at end of file
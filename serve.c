@@ -0,0 +1,329 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/signalfd.h>
+#include <sys/epoll.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <errno.h>
+#include "flush.h"
+
+#define SERVE_MAXCLIENTS 256
+#define SERVE_MAXEVENTS 64
+#define SERVE_BUFLEN 4096
+#define SERVE_MAXOUTPUT 65536
+
+/* Struct for the linked list of clients connected to the daemon. The messages of the session are
+ * written to the output memfd, and sent from there when the socket has room */
+struct serveClient {
+    int fd;
+    int output;
+    off_t sent;
+    int eof;
+    int closing;
+    int jobs;
+    int length;
+    char buffer[SERVE_BUFLEN];
+    flush_ctx *ctx;
+    struct serveClient *next;
+};
+
+/* Method to get the number of bytes in the output of a client that are not sent yet */
+static off_t pendingOutput(struct serveClient *client) {
+    return lseek(client->output, 0, SEEK_CUR) - client->sent;
+}
+
+/* Method to set the events epoll watches for a client. A client with a waiting line, or with too much
+ * output that it has not read, is not read from. A hang up is reported by epoll either way */
+static void watchClient(int epfd, struct serveClient *client) {
+    struct epoll_event event = { 0 };
+    off_t pending = pendingOutput(client);
+    if (!client->eof && pending < SERVE_MAXOUTPUT && memchr(client->buffer, '\n', client->length) == NULL) {
+        event.events |= EPOLLIN;
+    }
+    if (pending > 0) {
+        event.events |= EPOLLOUT;
+    }
+    event.data.fd = client->fd;
+    epoll_ctl(epfd, EPOLL_CTL_MOD, client->fd, &event);
+}
+
+/* Method to accept a new client. Every client gets its own session with its output going to the socket */
+static struct serveClient *acceptClient(int epfd, int sock, int devnull, struct serveClient *clients) {
+    int count = 0;
+    for (struct serveClient *client = clients; client != NULL; client = client->next) {
+        count++;
+    }
+
+    int fd = accept4(sock, NULL, NULL, SOCK_CLOEXEC);
+    if (fd == -1) {
+        perror("flush: accept error\n");
+        return clients;
+    }
+    if (count >= SERVE_MAXCLIENTS) {
+        dprintf(fd, "flush: too many clients\n");
+        close(fd);
+        return clients;
+    }
+
+    /* The jobs write to the socket themselves, but the daemon must never block on it */
+    struct serveClient *client = calloc(1, sizeof(struct serveClient));
+    if (client == NULL || (client->output = memfd_create("flush-output", MFD_CLOEXEC)) == -1
+            || (client->ctx = flush_ctx_new(FLUSH_SESSION)) == NULL) {
+        perror("flush: session error\n");
+        if (client != NULL && client->output > 0) {
+            close(client->output);
+        }
+        free(client);
+        close(fd);
+        return clients;
+    }
+    client->fd = fd;
+    flush_set_stdio(client->ctx, devnull, fd, fd);
+    flush_set_output(client->ctx, client->output, client->output);
+
+    struct epoll_event event = { 0 };
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &event);
+
+    /* The timer of the session, for the jobs started with "timeout" */
+    event.data.fd = flush_event_fd(client->ctx);
+    epoll_ctl(epfd, EPOLL_CTL_ADD, event.data.fd, &event);
+
+    client->next = clients;
+    return client;
+}
+
+/* Method to hang up a client that is gone. Its waiting lines are dropped and its jobs are hung up */
+static void hangUp(int epfd, struct serveClient *client) {
+    client->closing = 1;
+    client->length = 0;
+    epoll_ctl(epfd, EPOLL_CTL_DEL, client->fd, NULL);
+    flush_kill(client->ctx, SIGHUP);
+}
+
+/* Method to read from a client. A client that only shuts down its writing side still gets its lines run
+ * and their output, and only a client that hangs up completely loses them */
+static void readClient(int epfd, struct serveClient *client, int events) {
+    if (events & (EPOLLHUP | EPOLLERR)) {
+        hangUp(epfd, client);
+        return;
+    }
+    if (client->eof || !(events & EPOLLIN)) {
+        return;
+    }
+
+    ssize_t length = read(client->fd, client->buffer + client->length, SERVE_BUFLEN - client->length);
+    if (length == -1 && (errno == EINTR || errno == EAGAIN)) {
+        return;
+    }
+    if (length == -1) {
+        hangUp(epfd, client);
+        return;
+    }
+    if (length == 0) {
+        /* A last line without a newline runs as well */
+        client->eof = 1;
+        if (client->length > 0 && client->length < SERVE_BUFLEN && client->buffer[client->length - 1] != '\n') {
+            client->buffer[client->length++] = '\n';
+        }
+        return;
+    }
+    client->length += length;
+
+    /* Drops a line that does not fit in the buffer */
+    if (client->length == SERVE_BUFLEN && memchr(client->buffer, '\n', client->length) == NULL) {
+        dprintf(client->output, "flush: line is too long\n");
+        client->length = 0;
+    }
+}
+
+/* Method to send as much of the output of a client as the socket takes without blocking. Once all of
+ * it is sent, the memfd is emptied */
+static void sendOutput(int epfd, struct serveClient *client) {
+    char buffer[SERVE_BUFLEN];
+    off_t pending;
+
+    while ((pending = pendingOutput(client)) > 0) {
+        ssize_t length = pread(client->output, buffer, pending < SERVE_BUFLEN ? pending : SERVE_BUFLEN, client->sent);
+        if (length <= 0) {
+            break;
+        }
+        ssize_t sent = send(client->fd, buffer, length, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (sent == -1) {
+            if (errno != EAGAIN && errno != EINTR) {
+                hangUp(epfd, client);
+            }
+            return;
+        }
+        client->sent += sent;
+    }
+    if (client->sent > 0 && pending == 0) {
+        ftruncate(client->output, 0);
+        lseek(client->output, 0, SEEK_SET);
+        client->sent = 0;
+    }
+}
+
+/* Method to check whether a client may run another line. Output that has piled up is sent first */
+static int hasRoom(int epfd, struct serveClient *client) {
+    if (!client->closing && pendingOutput(client) >= SERVE_MAXOUTPUT) {
+        sendOutput(epfd, client);
+    }
+    return !client->closing && pendingOutput(client) < SERVE_MAXOUTPUT;
+}
+
+/* Method to run the waiting lines of every client, as long as the job limits allow it */
+static void runPending(int epfd, struct serveClient *clients, int maxJobs, int clientJobs) {
+    int total = 0;
+    for (struct serveClient *client = clients; client != NULL; client = client->next) {
+        total += client->jobs;
+    }
+
+    for (struct serveClient *client = clients; client != NULL; client = client->next) {
+        char *end;
+        while (client->jobs < clientJobs && total < maxJobs && hasRoom(epfd, client)
+                && (end = memchr(client->buffer, '\n', client->length)) != NULL) {
+            *end = '\0';
+            if (flush_spawn(client->ctx, client->buffer) > 0) {
+                client->jobs++;
+                total++;
+            }
+
+            client->length -= end + 1 - client->buffer;
+            memmove(client->buffer, end + 1, client->length);
+        }
+
+        if (!client->closing) {
+            sendOutput(epfd, client);
+        }
+        if (!client->closing) {
+            watchClient(epfd, client);
+        }
+    }
+}
+
+/* Method to check whether a client is done. It has hung up, or it has reached the end of its input and
+ * every one of its lines has run and its output is sent, and none of its jobs is left */
+static int isDone(struct serveClient *client) {
+    return client->jobs == 0 && (client->closing || (client->eof && pendingOutput(client) == 0
+        && memchr(client->buffer, '\n', client->length) == NULL));
+}
+
+/* Method to remove the clients that are done */
+static struct serveClient *removeClosed(struct serveClient *clients) {
+    struct serveClient **client = &clients;
+    while (*client != NULL) {
+        if (isDone(*client)) {
+            struct serveClient *closed = *client;
+            *client = closed->next;
+            close(closed->fd);
+            close(closed->output);
+            flush_ctx_free(closed->ctx);
+            free(closed);
+        }
+        else {
+            client = &(*client)->next;
+        }
+    }
+    return clients;
+}
+
+int flush_serve(const char *path, int maxJobs, int clientJobs) {
+    struct serveClient *clients = NULL;
+    struct sockaddr_un addr = { 0 };
+    sigset_t mask;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        printf("flush: socket path is too long\n");
+        return 1;
+    }
+
+    /* Signals are read from a signalfd, and a client that hangs up must not kill the daemon */
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+    signal(SIGPIPE, SIG_IGN);
+    int sfd = signalfd(-1, &mask, SFD_CLOEXEC);
+
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);
+    if (sfd == -1 || sock == -1 || bind(sock, (struct sockaddr *) &addr, sizeof(addr)) == -1
+            || listen(sock, SOMAXCONN) == -1) {
+        perror("flush: serve error\n");
+        return 1;
+    }
+
+    int devnull = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event event = { 0 };
+    event.events = EPOLLIN;
+    event.data.fd = sock;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, sock, &event);
+    event.data.fd = sfd;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, sfd, &event);
+
+    int running = 1;
+    while (running) {
+        struct epoll_event events[SERVE_MAXEVENTS];
+        int count = epoll_wait(epfd, events, SERVE_MAXEVENTS, -1);
+        if (count == -1 && errno != EINTR) {
+            perror("flush: epoll error\n");
+            break;
+        }
+
+        for (int i = 0; i < count; i++) {
+            int fd = events[i].data.fd;
+            if (fd == sock) {
+                clients = acceptClient(epfd, sock, devnull, clients);
+            }
+            else if (fd == sfd) {
+                /* Collects the finished jobs of every client. Their exit status is sent to the client */
+                struct signalfd_siginfo info;
+                if (read(sfd, &info, sizeof(info)) == sizeof(info) && info.ssi_signo != SIGCHLD) {
+                    running = 0;
+                }
+                for (struct serveClient *client = clients; client != NULL; client = client->next) {
+                    client->jobs = flush_wait(client->ctx, -1, FLUSH_NOHANG);
+                }
+            }
+            else {
+                for (struct serveClient *client = clients; client != NULL; client = client->next) {
+                    if (client->fd == fd) {
+                        readClient(epfd, client, events[i].events);
+                        break;
+                    }
+                    if (flush_event_fd(client->ctx) == fd) {
+                        client->jobs = flush_wait(client->ctx, -1, FLUSH_NOHANG);
+                        break;
+                    }
+                }
+            }
+        }
+
+        runPending(epfd, clients, maxJobs, clientJobs);
+        clients = removeClosed(clients);
+    }
+
+    /* Hangs up every job that is still running */
+    for (struct serveClient *client = clients; client != NULL; client = client->next) {
+        flush_kill(client->ctx, SIGHUP);
+    }
+    unlink(path);
+    close(sock);
+    close(epfd);
+    close(sfd);
+    close(devnull);
+    return 0;
+}